@@ -0,0 +1,206 @@
+#ifndef LIB_EKIO_BENCH_H
+#define LIB_EKIO_BENCH_H
+
+#include "libekio.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Shared helpers of the microbenchmarks.
+ *
+ * Every benchmark takes the same options:
+ *   -b <backend>  epoll, io_uring, kqueue, poll or any (default any)
+ *   -n <count>    operations to measure
+ *   -c <count>    connections, where the benchmark has any
+ * and prints one line per measured operation with p50/p99/p999 in
+ * nanoseconds, so runs on two backends can be diffed line by line.
+ */
+
+typedef struct bench_options
+{
+    int backend;      // EV_BACKEND_*
+    const char *name; // As given with -b
+    long count;
+    int connections;
+} bench_options_t;
+
+typedef struct bench_samples
+{
+    uint64_t *values;
+    size_t count;
+    size_t capacity;
+} bench_samples_t;
+
+static inline uint64_t bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline void bench_parse(int argc, char **argv, bench_options_t *options, long count, int connections)
+{
+    options->backend = EV_BACKEND_ANY;
+    options->name = "any";
+    options->count = count;
+    options->connections = connections;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:n:c:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+            options->name = optarg;
+            if (strcmp(optarg, "epoll") == 0)
+                options->backend = EV_BACKEND_EPOLL;
+            else if (strcmp(optarg, "io_uring") == 0)
+                options->backend = EV_BACKEND_IO_URING;
+            else if (strcmp(optarg, "kqueue") == 0)
+                options->backend = EV_BACKEND_KQUEUE;
+            else if (strcmp(optarg, "poll") == 0)
+                options->backend = EV_BACKEND_POLL;
+            else if (strcmp(optarg, "any") != 0)
+            {
+                fprintf(stderr, "Unknown backend %s\n", optarg);
+                exit(2);
+            }
+            break;
+        case 'n':
+            options->count = atol(optarg);
+            break;
+        case 'c':
+            options->connections = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-b epoll|io_uring|kqueue|poll|any] [-n count] [-c connections]\n", argv[0]);
+            exit(2);
+        }
+    }
+}
+
+// Loop on exactly the requested backend, a benchmark never silently falls back
+static inline ev_loop_t *bench_loop(const bench_options_t *options)
+{
+    ev_loop_t *loop = ev_loop_create_with(options->backend);
+    if (!loop)
+    {
+        fprintf(stderr, "Backend %s is not available here\n", options->name);
+        exit(77);
+    }
+    return loop;
+}
+
+static inline const char *bench_backend_name(ev_loop_t *loop)
+{
+    switch (ev_loop_backend(loop))
+    {
+    case EV_BACKEND_EPOLL:
+        return "epoll";
+    case EV_BACKEND_IO_URING:
+        return "io_uring";
+    case EV_BACKEND_KQUEUE:
+        return "kqueue";
+    case EV_BACKEND_POLL:
+        return "poll";
+    }
+    return "?";
+}
+
+static inline void bench_samples_init(bench_samples_t *samples, size_t capacity)
+{
+    samples->values = (uint64_t *)malloc(sizeof(uint64_t) * capacity);
+    samples->count = 0;
+    samples->capacity = samples->values ? capacity : 0;
+}
+
+static inline void bench_samples_add(bench_samples_t *samples, uint64_t value)
+{
+    // Sized up front, growing would show up in the very numbers we take
+    if (samples->count < samples->capacity)
+        samples->values[samples->count++] = value;
+}
+
+static inline int bench_compare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static inline uint64_t bench_percentile(const bench_samples_t *samples, double q)
+{
+    size_t rank = (size_t)(q * samples->count);
+    return samples->values[rank < samples->count ? rank : samples->count - 1];
+}
+
+// One result line: what, backend, samples, ops/s over `elapsed` ns, percentiles
+static inline void bench_report(const char *what, ev_loop_t *loop, bench_samples_t *samples, uint64_t elapsed)
+{
+    if (samples->count == 0)
+    {
+        printf("%-16s %-8s no samples\n", what, bench_backend_name(loop));
+        return;
+    }
+
+    qsort(samples->values, samples->count, sizeof(uint64_t), bench_compare);
+    printf("%-16s %-8s n=%-9zu %12.0f ops/s  p50=%-8llu p99=%-8llu p999=%-8llu max=%llu ns\n", what,
+           bench_backend_name(loop), samples->count, elapsed ? samples->count * 1e9 / elapsed : 0.0,
+           (unsigned long long)bench_percentile(samples, 0.5), (unsigned long long)bench_percentile(samples, 0.99),
+           (unsigned long long)bench_percentile(samples, 0.999),
+           (unsigned long long)samples->values[samples->count - 1]);
+}
+
+static inline void bench_samples_destroy(bench_samples_t *samples)
+{
+    free(samples->values);
+    samples->values = NULL;
+    samples->count = samples->capacity = 0;
+}
+
+static inline void bench_nonblock(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+// Listening loopback socket on an ephemeral port, stores the address in `addr`
+static inline int bench_listen(struct sockaddr_in *addr)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(*addr);
+    if (bind(fd, (struct sockaddr *)addr, len) != 0 || listen(fd, 4096) != 0 ||
+        getsockname(fd, (struct sockaddr *)addr, &len) != 0)
+    {
+        perror("bench listen");
+        exit(1);
+    }
+    bench_nonblock(fd);
+    return fd;
+}
+
+static inline int bench_connect(const struct sockaddr_in *addr)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) != 0)
+    {
+        perror("bench connect");
+        exit(1);
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+#endif
@@ -0,0 +1,99 @@
+#include "bench.h"
+#include <pthread.h>
+
+/**
+ * fd churn: a server loop on its own thread accepts each connection, starts
+ * a watcher on it, and on its first byte stops the watcher and closes it. The
+ * main thread connects, sends one byte and waits for the close. Each sample
+ * is one connection from connect() to the server's close, ops/s is the
+ * accept+close rate.
+ *
+ * ./churn -b epoll -n 20000
+ */
+
+static ev_loop_t *server_loop;
+static ev_io_t accept_watcher;
+static ev_async_t stop_async;
+
+static void server_read_cb(ev_io_t *watcher, int revents)
+{
+    (void)revents;
+    char byte;
+    if (read(watcher->fd, &byte, 1) < 0)
+        return;
+
+    ev_io_stop(server_loop, watcher);
+    close(watcher->fd);
+    free(watcher);
+}
+
+static void server_accept_cb(ev_io_t *watcher, int revents)
+{
+    (void)revents;
+    int fd;
+    while ((fd = accept(watcher->fd, NULL, NULL)) >= 0)
+    {
+        bench_nonblock(fd);
+        ev_io_t *connection = (ev_io_t *)malloc(sizeof(ev_io_t));
+        ev_io_init(connection, server_read_cb, fd, EV_READ);
+        ev_io_start(server_loop, connection);
+    }
+}
+
+static void server_stop_cb(ev_async_t *watcher, int revents)
+{
+    (void)revents;
+    ev_io_stop(server_loop, &accept_watcher);
+    ev_async_stop(server_loop, watcher);
+}
+
+static void *server_thread(void *arg)
+{
+    (void)arg;
+    ev_run(server_loop, 0);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t options;
+    // Every connection leaves a TIME_WAIT behind, stay well below the port range
+    bench_parse(argc, argv, &options, 20000, 0);
+    server_loop = bench_loop(&options);
+
+    struct sockaddr_in addr;
+    int listen_fd = bench_listen(&addr);
+    ev_io_init(&accept_watcher, server_accept_cb, listen_fd, EV_READ);
+    ev_io_start(server_loop, &accept_watcher);
+    ev_async_init(&stop_async, server_stop_cb);
+    ev_async_start(server_loop, &stop_async);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_thread, NULL);
+
+    bench_samples_t samples;
+    bench_samples_init(&samples, options.count);
+
+    uint64_t start = bench_now();
+    for (long i = 0; i < options.count; i++)
+    {
+        uint64_t t0 = bench_now();
+        int fd = bench_connect(&addr);
+        char byte = 'x';
+        write(fd, &byte, 1);
+        while (read(fd, &byte, 1) > 0)
+            ;
+        bench_samples_add(&samples, bench_now() - t0);
+        close(fd);
+    }
+    uint64_t elapsed = bench_now() - start;
+
+    ev_async_send(server_loop, &stop_async);
+    pthread_join(thread, NULL);
+    bench_report("fd-churn", server_loop, &samples, elapsed);
+
+    close(listen_fd);
+    bench_samples_destroy(&samples);
+    ev_loop_destroy(server_loop);
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include "bench.h"
+#include <pthread.h>
+
+/**
+ * Loopback echo: an echo server loop on its own thread, a client loop on the
+ * main thread keeps one 64-byte message in flight on each of -c connections.
+ * Each sample is one message's round trip, ops/s is the echo throughput.
+ *
+ * ./echo -b io_uring -c 64 -n 1000000
+ */
+
+#define MESSAGE_SIZE 64
+
+typedef struct connection
+{
+    ev_io_t watcher;
+    int received; // Bytes of the current echo back so far
+    uint64_t sent;
+} connection_t;
+
+static ev_loop_t *server_loop;
+static ev_io_t accept_watcher;
+static ev_async_t stop_async;
+static bench_samples_t samples;
+static long remaining;
+
+static void server_read_cb(ev_io_t *watcher, int revents)
+{
+    (void)revents;
+    char buffer[4096];
+    ssize_t n = read(watcher->fd, buffer, sizeof(buffer));
+    if (n > 0)
+    {
+        // Loopback never fills a socket buffer at one message per connection
+        write(watcher->fd, buffer, n);
+        return;
+    }
+    if (n < 0)
+        return;
+
+    ev_io_stop(server_loop, watcher);
+    close(watcher->fd);
+    free(watcher);
+}
+
+static void server_accept_cb(ev_io_t *watcher, int revents)
+{
+    (void)revents;
+    int fd;
+    while ((fd = accept(watcher->fd, NULL, NULL)) >= 0)
+    {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        bench_nonblock(fd);
+
+        ev_io_t *connection = (ev_io_t *)malloc(sizeof(ev_io_t));
+        ev_io_init(connection, server_read_cb, fd, EV_READ);
+        ev_io_start(server_loop, connection);
+    }
+}
+
+static void server_stop_cb(ev_async_t *watcher, int revents)
+{
+    (void)revents;
+    ev_io_stop(server_loop, &accept_watcher);
+    ev_async_stop(server_loop, watcher);
+}
+
+static void *server_thread(void *arg)
+{
+    (void)arg;
+    ev_run(server_loop, 0);
+    return NULL;
+}
+
+static void client_send(connection_t *connection)
+{
+    char message[MESSAGE_SIZE];
+    memset(message, 'x', sizeof(message));
+    connection->received = 0;
+    connection->sent = bench_now();
+    write(connection->watcher.fd, message, sizeof(message));
+}
+
+static void client_read_cb(ev_io_t *watcher, int revents)
+{
+    (void)revents;
+    connection_t *connection = (connection_t *)watcher;
+    char buffer[MESSAGE_SIZE];
+
+    ssize_t n = read(watcher->fd, buffer, MESSAGE_SIZE - connection->received);
+    if (n <= 0)
+        return;
+    connection->received += n;
+    if (connection->received < MESSAGE_SIZE)
+        return;
+
+    bench_samples_add(&samples, bench_now() - connection->sent);
+    if (remaining > 0)
+    {
+        remaining--;
+        client_send(connection);
+        return;
+    }
+
+    ev_io_stop(ev_current_loop(), watcher);
+    close(watcher->fd);
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t options;
+    bench_parse(argc, argv, &options, 1000000, 64);
+    if (options.connections < 1)
+        options.connections = 1;
+
+    server_loop = bench_loop(&options);
+    ev_loop_t *loop = bench_loop(&options);
+
+    struct sockaddr_in addr;
+    int listen_fd = bench_listen(&addr);
+    ev_io_init(&accept_watcher, server_accept_cb, listen_fd, EV_READ);
+    ev_io_start(server_loop, &accept_watcher);
+    ev_async_init(&stop_async, server_stop_cb);
+    ev_async_start(server_loop, &stop_async);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_thread, NULL);
+
+    connection_t *connections = (connection_t *)calloc(options.connections, sizeof(connection_t));
+    for (int i = 0; i < options.connections; i++)
+    {
+        int fd = bench_connect(&addr);
+        bench_nonblock(fd);
+        ev_io_init(&connections[i].watcher, client_read_cb, fd, EV_READ);
+        ev_io_start(loop, &connections[i].watcher);
+    }
+
+    bench_samples_init(&samples, options.count + options.connections);
+    remaining = options.count > options.connections ? options.count - options.connections : 0;
+
+    uint64_t start = bench_now();
+    for (int i = 0; i < options.connections; i++)
+        client_send(&connections[i]);
+    ev_run(loop, 0);
+    uint64_t elapsed = bench_now() - start;
+
+    ev_async_send(server_loop, &stop_async);
+    pthread_join(thread, NULL);
+
+    char what[32];
+    snprintf(what, sizeof(what), "echo-c%d", options.connections);
+    bench_report(what, loop, &samples, elapsed);
+
+    close(listen_fd);
+    free(connections);
+    bench_samples_destroy(&samples);
+    ev_loop_destroy(loop);
+    ev_loop_destroy(server_loop);
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "bench.h"
+
+/**
+ * Pipe ping-pong: one byte bounces between two pipes inside one loop, each
+ * sample is a full round trip (two writes, two wakeups, two reads).
+ *
+ * ./pingpong -b epoll -n 1000000
+ */
+
+static int ping[2], pong[2];
+static ev_io_t ping_watcher, pong_watcher;
+static bench_samples_t samples;
+static long remaining;
+static uint64_t sent;
+
+static void ping_cb(ev_io_t *watcher, int revents)
+{
+    (void)revents;
+    char byte;
+    if (read(watcher->fd, &byte, 1) == 1)
+        write(pong[1], &byte, 1);
+}
+
+static void pong_cb(ev_io_t *watcher, int revents)
+{
+    (void)revents;
+    char byte;
+    if (read(watcher->fd, &byte, 1) != 1)
+        return;
+
+    bench_samples_add(&samples, bench_now() - sent);
+    if (--remaining == 0)
+    {
+        ev_io_stop(ev_current_loop(), &ping_watcher);
+        ev_io_stop(ev_current_loop(), &pong_watcher);
+        return;
+    }
+
+    sent = bench_now();
+    write(ping[1], &byte, 1);
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t options;
+    bench_parse(argc, argv, &options, 1000000, 0);
+    ev_loop_t *loop = bench_loop(&options);
+
+    if (pipe(ping) != 0 || pipe(pong) != 0)
+    {
+        perror("pipe");
+        return 1;
+    }
+    bench_nonblock(ping[0]);
+    bench_nonblock(pong[0]);
+
+    ev_io_init(&ping_watcher, ping_cb, ping[0], EV_READ);
+    ev_io_init(&pong_watcher, pong_cb, pong[0], EV_READ);
+    ev_io_start(loop, &ping_watcher);
+    ev_io_start(loop, &pong_watcher);
+
+    bench_samples_init(&samples, options.count);
+    remaining = options.count;
+
+    uint64_t start = bench_now();
+    sent = start;
+    write(ping[1], "x", 1);
+    ev_run(loop, 0);
+    bench_report("pipe-pingpong", loop, &samples, bench_now() - start);
+
+    bench_samples_destroy(&samples);
+    ev_loop_destroy(loop);
+    return 0;
+}
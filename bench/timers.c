@@ -0,0 +1,93 @@
+#include "bench.h"
+
+/**
+ * Timer heap: -n timers (1M by default) are started and stopped one by one,
+ * each sample is one call. Then all of them are started again with deadlines
+ * spread over a second and the loop runs until every one fired; those samples
+ * are how late each timer's callback ran.
+ *
+ * ./timers -b epoll -n 1000000
+ */
+
+#define EXPIRE_SPREAD 1.0
+
+static ev_timer_t *timers;
+static double *deadlines;
+static bench_samples_t samples;
+static uint64_t seed = 88172645463325252ull;
+
+// xorshift, the same timeouts on every run and backend
+static double bench_random(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return (seed >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void expire_cb(ev_timer_t *timer, int revents)
+{
+    (void)revents;
+    uint64_t deadline = (uint64_t)(deadlines[timer - timers] * 1e9);
+    uint64_t now = bench_now();
+    bench_samples_add(&samples, now > deadline ? now - deadline : 0);
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t options;
+    bench_parse(argc, argv, &options, 1000000, 0);
+    ev_loop_t *loop = bench_loop(&options);
+    long count = options.count;
+
+    timers = (ev_timer_t *)calloc(count, sizeof(ev_timer_t));
+    deadlines = (double *)malloc(sizeof(double) * count);
+    bench_samples_init(&samples, count);
+    if (!timers || !deadlines || samples.capacity == 0)
+    {
+        perror("Failed to allocate timers");
+        return 1;
+    }
+
+    // Deadlines far enough out that nothing fires while we measure
+    for (long i = 0; i < count; i++)
+        ev_timer_init(&timers[i], expire_cb, 10 + bench_random(), 0);
+
+    uint64_t start = bench_now();
+    for (long i = 0; i < count; i++)
+    {
+        uint64_t t0 = bench_now();
+        ev_timer_start(loop, &timers[i]);
+        bench_samples_add(&samples, bench_now() - t0);
+    }
+    bench_report("timer-start", loop, &samples, bench_now() - start);
+
+    samples.count = 0;
+    start = bench_now();
+    for (long i = 0; i < count; i++)
+    {
+        uint64_t t0 = bench_now();
+        ev_timer_stop(loop, &timers[i]);
+        bench_samples_add(&samples, bench_now() - t0);
+    }
+    bench_report("timer-stop", loop, &samples, bench_now() - start);
+
+    samples.count = 0;
+    ev_now_update(loop);
+    for (long i = 0; i < count; i++)
+    {
+        double after = bench_random() * EXPIRE_SPREAD;
+        ev_timer_set(&timers[i], after, 0);
+        ev_timer_start(loop, &timers[i]);
+        deadlines[i] = ev_now(loop) + after;
+    }
+    start = bench_now();
+    ev_run(loop, 0);
+    bench_report("timer-lateness", loop, &samples, bench_now() - start);
+
+    free(timers);
+    free(deadlines);
+    bench_samples_destroy(&samples);
+    ev_loop_destroy(loop);
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "bench.h"
+#include <pthread.h>
+
+/**
+ * Cross-thread wakeup: the main thread ev_async_send()s into a loop that is
+ * blocked in its poll on another thread and waits for the callback before the
+ * next send. Each sample is one send to callback latency.
+ *
+ * ./wakeup -b io_uring -n 200000
+ */
+
+static ev_loop_t *loop;
+static ev_async_t async;
+static bench_samples_t samples;
+static uint64_t sent;
+static long acked;
+static long count;
+
+static void async_cb(ev_async_t *watcher, int revents)
+{
+    (void)revents;
+    bench_samples_add(&samples, bench_now() - __atomic_load_n(&sent, __ATOMIC_ACQUIRE));
+    long done = __atomic_add_fetch(&acked, 1, __ATOMIC_RELEASE);
+    if (done == count)
+        ev_async_stop(loop, watcher);
+}
+
+static void *loop_thread(void *arg)
+{
+    (void)arg;
+    ev_run(loop, 0);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t options;
+    bench_parse(argc, argv, &options, 200000, 0);
+    loop = bench_loop(&options);
+    count = options.count;
+
+    bench_samples_init(&samples, count);
+    ev_async_init(&async, async_cb);
+    ev_async_start(loop, &async);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, loop_thread, NULL);
+
+    uint64_t start = bench_now();
+    for (long i = 0; i < count; i++)
+    {
+        // Give the loop a moment to go back to sleep, we measure wakeups
+        uint64_t settle = bench_now() + 2000;
+        while (bench_now() < settle)
+            ;
+
+        __atomic_store_n(&sent, bench_now(), __ATOMIC_RELEASE);
+        ev_async_send(loop, &async);
+        while (__atomic_load_n(&acked, __ATOMIC_ACQUIRE) <= i)
+            ;
+    }
+    uint64_t elapsed = bench_now() - start;
+
+    pthread_join(thread, NULL);
+    bench_report("async-wakeup", loop, &samples, elapsed);
+
+    bench_samples_destroy(&samples);
+    ev_loop_destroy(loop);
+    return 0;
+}
@@ -63,11 +63,9 @@ void write_callback(ev_io_t *w, int revents)
         return;
     }
 
-    // Switch to reading mode
-    ev_io_stop(ev_default_loop(), w);
-    ev_io_init(&conn->io_watcher, read_callback, conn->sockfd, EV_READ);
-    conn->io_watcher.data = conn;
-    ev_io_start(ev_default_loop(), &conn->io_watcher);
+    // Switch to reading mode, the watcher stays registered
+    w->callback = read_callback;
+    ev_io_modify(ev_default_loop(), w, EV_READ);
 }
 
 // Initiate a connection and register it with the event loop
@@ -125,20 +123,59 @@ void initiate_request(ev_loop_t *loop, const char *hostname, const char *ip_addr
     ev_io_start(loop, &conn->io_watcher);
 }
 
-int main()
+// Resolving the host blocks, so it runs on the thread pool
+typedef struct
 {
-    const char *hostname = "local host";
-    // const char *ip_address = resolve_host(hostname);
+    ev_work_t work;
+    char hostname[256];
+    char ip_address[INET_ADDRSTRLEN];
+    int status;
+} resolve_t;
 
-    const char *ip_address = "0.0.0.0";
-    ev_loop_t *loop = ev_default_loop();
+// Runs on a pool thread
+void resolve_work(ev_work_t *work)
+{
+    resolve_t *resolve = (resolve_t *)work->data;
+    struct addrinfo hints = {0};
+    struct addrinfo *result;
+
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    resolve->status = getaddrinfo(resolve->hostname, NULL, &hints, &result);
+    if (resolve->status == 0)
+    {
+        struct sockaddr_in *addr = (struct sockaddr_in *)result->ai_addr;
+        inet_ntop(AF_INET, &addr->sin_addr, resolve->ip_address, sizeof(resolve->ip_address));
+        freeaddrinfo(result);
+    }
+}
+
+// Back on the loop thread once the host is resolved
+void resolve_done(ev_work_t *work, int status)
+{
+    resolve_t *resolve = (resolve_t *)work->data;
+    if (status != 0 || resolve->status != 0)
+    {
+        fprintf(stderr, "Failed to resolve %s\n", resolve->hostname);
+        return;
+    }
 
-    // Initiate 100 connections to the same hostname
+    // Initiate 4 connections to the same hostname
     for (int i = 0; i < 4; i++)
     {
         printf("Initiated Request %d\n", i + 1);
-        initiate_request(loop, hostname, ip_address, i + 1);
+        initiate_request(ev_default_loop(), resolve->hostname, resolve->ip_address, i + 1);
     }
+}
+
+int main()
+{
+    static resolve_t resolve;
+    ev_loop_t *loop = ev_default_loop();
+
+    strcpy(resolve.hostname, "localhost");
+    resolve.work.data = &resolve;
+    ev_work_submit(loop, &resolve.work, resolve_work, resolve_done);
 
     // Run the custom event loop
     ev_run(loop, 0);
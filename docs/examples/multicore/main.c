@@ -0,0 +1,119 @@
+#include "libekio.h"
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * One echo server loop per CPU, each accepting on its own SO_REUSEPORT socket.
+ * Ctrl-C reaches loop 0 through a signal watcher, which stops every loop.
+ *
+ * nc 127.0.0.1 8080
+ */
+
+typedef struct client
+{
+    ev_io_t watcher;
+    char buffer[4096];
+} client_t;
+
+static ev_runtime_t *runtime;
+static ev_signal_t interrupt_watcher;
+
+static void client_close(client_t *client)
+{
+    ev_io_stop(ev_current_loop(), &client->watcher);
+    close(client->watcher.fd);
+    ev_pool_free(ev_loop_pool(ev_current_loop()), client);
+}
+
+static void client_cb(ev_io_t *watcher, int revents)
+{
+    (void)revents;
+    client_t *client = (client_t *)watcher;
+    ssize_t n = read(watcher->fd, client->buffer, sizeof(client->buffer));
+
+    // Closed, failed, or too slow to take the echo back in one go
+    if (n <= 0 || write(watcher->fd, client->buffer, n) != n)
+        client_close(client);
+}
+
+static void accept_cb(ev_io_t *watcher, int revents)
+{
+    (void)revents;
+    int client_fd;
+    while ((client_fd = accept(watcher->fd, NULL, NULL)) >= 0)
+    {
+        // Each loop hands out clients from its own slab pool, no malloc lock shared between CPUs
+        client_t *client = (client_t *)ev_pool_alloc(ev_loop_pool(ev_current_loop()), sizeof(client_t));
+        if (!client)
+        {
+            close(client_fd);
+            continue;
+        }
+        ev_io_init(&client->watcher, client_cb, client_fd, EV_READ);
+        ev_io_start(ev_current_loop(), &client->watcher);
+    }
+}
+
+// Runs on loop 0's thread like any other callback, so it may stop the runtime
+static void interrupt_cb(ev_signal_t *watcher, int revents)
+{
+    (void)watcher;
+    (void)revents;
+    ev_runtime_stop(runtime);
+}
+
+// Runs on every loop's own thread before the loop starts
+static void setup(ev_loop_t *loop, int index, int listen_fd, void *data)
+{
+    (void)data;
+
+    // Lives as long as the process, like the loop it belongs to
+    ev_io_t *accept_watcher = (ev_io_t *)malloc(sizeof(ev_io_t));
+    ev_io_init(accept_watcher, accept_cb, listen_fd, EV_READ);
+    ev_io_start(loop, accept_watcher);
+
+    // A signal belongs to one loop at a time
+    if (index == 0)
+    {
+        ev_signal_init(&interrupt_watcher, interrupt_cb, SIGINT);
+        ev_signal_start(loop, &interrupt_watcher);
+    }
+}
+
+int main()
+{
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(8080);
+    addr.sin_addr.s_addr = INADDR_ANY;
+
+    ev_runtime_options_t options;
+    ev_runtime_options_init(&options);
+    options.listen_addr = (struct sockaddr *)&addr;
+    options.listen_addrlen = sizeof(addr);
+    options.setup = setup;
+
+    ev_io_setup_sigpipe_handling();
+
+    // Every thread but loop 0's keeps SIGINT blocked, loop threads inherit
+    // this mask, so the signal waits for loop 0's watcher
+    sigset_t interrupt;
+    sigemptyset(&interrupt);
+    sigaddset(&interrupt, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &interrupt, NULL);
+
+    runtime = ev_runtime_create(&options);
+    if (!runtime || ev_runtime_start(runtime) != 0)
+        return 1;
+
+    printf("Echo server is running on port 8080 with %d loops\n", ev_runtime_size(runtime));
+
+    ev_runtime_join(runtime);
+    ev_runtime_destroy(runtime);
+    return 0;
+}
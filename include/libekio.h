@@ -3,6 +3,9 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/socket.h>
 
 /*
  *
@@ -19,9 +22,46 @@
 #define EVBREAK_ONE 1
 #define EVBREAK_ALL 2
 
+// Default size and growth cap of the backend ready-event array
+#define EV_DEFAULT_MAX_EVENTS 64
+#define EV_DEFAULT_MAX_EVENTS_CAP 4096
+// Consecutive mostly-idle polls before the ready-event array is halved
+#define EV_EVENTS_SHRINK_POLLS 1024
+
+// Backend kinds, or'ed in ev_loop_options_t.backends. Loops take the first
+// one that works in this order: io_uring, epoll, kqueue, poll.
+#define EV_BACKEND_EPOLL 0x1
+#define EV_BACKEND_IO_URING 0x2
+#define EV_BACKEND_KQUEUE 0x4
+#define EV_BACKEND_POLL 0x8
+#define EV_BACKEND_ANY 0xf
+
 // event type
 #define TIMER_EVENT 1
 #define IO_EVENT 2
+#define REQ_EVENT 3
+#define ASYNC_EVENT 4
+#define WORK_EVENT 5
+#define SIGNAL_EVENT 6
+#define PREPARE_EVENT 7
+#define CHECK_EVENT 8
+#define IDLE_EVENT 9
+#define FORK_EVENT 10
+
+// async request operations
+enum
+{
+    EV_OP_READ = 1,
+    EV_OP_WRITE,
+    EV_OP_ACCEPT,
+    EV_OP_CONNECT,
+    EV_OP_SENDMSG,
+    EV_OP_READ_POOLED,
+    EV_OP_SEND_ZC
+};
+
+// Largest buffer pool, io_uring buffer ids are 16 bit
+#define EV_BUF_POOL_MAX_COUNT 32768
 
 enum
 {
@@ -29,14 +69,56 @@ enum
     EV_WRITE = 0x2
 };
 
+// Watcher modes, or'ed into ev_io_t.events.
+// EV_ET: edge-triggered, notify once per readiness change.
+// EV_ONESHOT: stop the watcher after its first event, restarting re-arms it.
+// EV_ONESHOT is spelled exactly like <sys/event.h>'s flag so both headers can
+// be included in any order.
+#define EV_ET 0x100
+#ifndef EV_ONESHOT
+#define EV_ONESHOT 0x0010
+#endif
+
+// I/O watcher priorities. Ready watchers are called from EV_MAXPRI down, a
+// priority's callbacks per iteration can be capped with ev_loop_set_budget.
+#define EV_MINPRI -2
+#define EV_MAXPRI 2
+
 // IO watcher structure
 typedef struct ev_io ev_io_t;
+// Ready I/O watchers waiting for their callback, by priority (internal)
+typedef struct ev_pending_queue ev_pending_queue_t;
 // Backend-specific structure
 typedef struct ev_backend ev_backend_t;
 // timeout related structure
 typedef struct ev_timer ev_timer_t;
+// async (completion based) request structure
+typedef struct ev_req ev_req_t;
+// receive buffer pool structure
+typedef struct ev_buf_pool ev_buf_pool_t;
+// fixed-size object pool (opaque)
+typedef struct ev_pool ev_pool_t;
+// cross-thread wakeup watcher structure
+typedef struct ev_async ev_async_t;
+// closure posted to a loop from any thread
+typedef struct ev_task ev_task_t;
+// blocking work run on the thread pool
+typedef struct ev_work ev_work_t;
+// signal watcher structure
+typedef struct ev_signal ev_signal_t;
+// hooks around every loop iteration
+typedef struct ev_prepare ev_prepare_t;
+typedef struct ev_check ev_check_t;
+typedef struct ev_idle ev_idle_t;
+typedef struct ev_fork ev_fork_t;
 // Event loop structure
 typedef struct ev_loop ev_loop_t;
+// Loop creation options
+typedef struct ev_loop_options ev_loop_options_t;
+// Thread-per-core runtime (opaque)
+typedef struct ev_runtime ev_runtime_t;
+// Runtime creation options
+typedef struct ev_runtime_options ev_runtime_options_t;
 
 /**
  *
@@ -45,15 +127,94 @@ typedef struct ev_loop ev_loop_t;
  *
  *
  */
+struct ev_loop_options
+{
+    int max_events;     // Initial size of the ready-event array
+    int max_events_cap; // Size the array may grow to while polls keep filling it
+    int work_queue_depth; // Most thread pool items in flight, 0 for no limit
+    int work_max_wait;    // Ms an item may wait for a worker before it is shed, 0 for no limit
+    int backends;         // EV_BACKEND_* kinds to try, best first; 0 for any
+    int stats;            // Non-zero to collect ev_loop_stats metrics (a few clock reads per callback)
+    int pool;             // Non-zero to allocate the loop's per-fd bookkeeping from ev_loop_pool
+};
+
+// Log2 histogram, bucket 0 counts zeros and bucket i values in [2^(i-1), 2^i)
+#define EV_STATS_BUCKETS 32
+typedef struct ev_histogram
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[EV_STATS_BUCKETS];
+} ev_histogram_t;
+
+// Loop metrics, times in microseconds. Every field is a uint64_t.
+typedef struct ev_loop_stats
+{
+    uint64_t iterations;
+    uint64_t events;       // I/O events reported by the backend
+    uint64_t callbacks;    // I/O callbacks called
+    uint64_t timers_fired;
+    uint64_t active_ios;    // Backend registrations at the end of the last iteration, a shared fd counts once
+    uint64_t active_timers; // Same, started timers
+    uint64_t pending;       // Same, I/O callbacks left over budget
+    ev_histogram_t poll_wait;      // Time blocked in the backend
+    ev_histogram_t poll_events;    // Events per poll
+    ev_histogram_t dispatch;       // Time from the poll returning to the end of the iteration
+    ev_histogram_t callback;       // Time in each I/O and timer callback
+    ev_histogram_t timer_lateness; // Time past its deadline a timer fired
+} ev_loop_stats_t;
+
+// A callback caught by the watchdog while still running
+typedef struct ev_slow_callback
+{
+    struct ev_loop *loop;
+    int type;               // *_EVENT of the watcher
+    int fd;                 // The watcher's fd, -1 if it has none
+    const void *watcher;    // To tell watchers apart, it may be gone by the time the hook runs
+    const void *callback;   // Address of the callback function
+    unsigned int iteration; // ev_iteration when the callback was called
+    double elapsed;         // Seconds it had been running
+} ev_slow_callback_t;
+
+typedef void (*ev_watchdog_cb)(const ev_slow_callback_t *report, void *data);
+
+void ev_loop_options_init(ev_loop_options_t *options);
 struct ev_loop *ev_default_loop();
+// Loop running ev_run on the calling thread, NULL outside of ev_run
+struct ev_loop *ev_current_loop();
 struct ev_loop *ev_loop_create();
+struct ev_loop *ev_loop_create_with_options(const ev_loop_options_t *options);
+// Loop on the best working backend among `backends` (EV_BACKEND_*, or'ed)
+struct ev_loop *ev_loop_create_with(int backends);
 void ev_loop_destroy(struct ev_loop *loop);
 int ev_run(struct ev_loop *loop, int flags);
 void ev_break(struct ev_loop *loop, int how);
 unsigned int ev_iteration(struct ev_loop *loop);
 unsigned int ev_depth(struct ev_loop *loop);
+// Monotonic seconds sampled once per iteration when the poll returns. Timers
+// are scheduled from it, so a timer started after a long blocking callback
+// counts from before that callback unless ev_now_update is called first.
+double ev_now(struct ev_loop *loop);
+void ev_now_update(struct ev_loop *loop);
+// EV_BACKEND_* the loop was created on
+int ev_loop_backend(struct ev_loop *loop);
+// Cap the I/O callbacks of `priority` per iteration, the rest waits for the next one
+void ev_loop_set_budget(struct ev_loop *loop, int priority, int budget);
+// Copy the loop's metrics from any thread without locking, -1 unless the loop
+// was created with options.stats
+int ev_loop_stats(struct ev_loop *loop, ev_loop_stats_t *stats);
+// Upper bound of the bucket holding the q-th quantile (0..1) of a histogram
+uint64_t ev_histogram_percentile(const ev_histogram_t *histogram, double q);
+// Report every I/O or timer callback that runs longer than threshold_ms, once
+// per call, to `hook` on a watchdog thread; a threshold of 0 turns it off.
+// Call from the loop's thread.
+int ev_loop_set_watchdog(struct ev_loop *loop, int threshold_ms, ev_watchdog_cb hook, void *data);
 void ev_suspend(struct ev_loop *loop);
 void ev_resume(struct ev_loop *loop);
+// Call in the child after fork() before using the loop there, it gets its
+// own backend with every started I/O and signal watcher registered again
+int ev_loop_fork(struct ev_loop *loop);
 
 /**
  *
@@ -71,12 +232,17 @@ struct ev_io
     ev_io_cb callback; // Callback function
     void *data;        // User data associated with this watcher
     bool active;       // if io is active or not
+    int priority;      // EV_MINPRI to EV_MAXPRI, higher ones are called first
+    int pending;       // Slot in the loop's pending queue plus one, 0 if none (internal)
+    struct ev_io *next_fd; // Next watcher of the same fd (internal)
 };
 
 void ev_io_init(ev_io_t *watcher, ev_io_cb callback, int fd, int events);
+void ev_io_set_priority(ev_io_t *watcher, int priority);
 void ev_io_set(ev_io_t *watcher, int fd, int events);
 void ev_io_start(ev_loop_t *loop, ev_io_t *watcher);
 void ev_io_stop(ev_loop_t *loop, ev_io_t *watcher);
+void ev_io_modify(ev_loop_t *loop, ev_io_t *watcher, int events);
 void ev_io_handle_sigpipe(int signo);
 void ev_io_setup_sigpipe_handling();
 
@@ -100,6 +266,9 @@ struct ev_timer
     void *data;           // User data
     int active;           // Internal flag for active status
     uintptr_t ident;      // Unique identifier for the timer
+    double at;            // Heap key: absolute monotonic expiry time (internal)
+    double expires;       // Real expiry, later than `at` after a lazy re-arm (internal)
+    int heap_index;       // Slot in the loop's timer heap, -1 if inactive (internal)
 };
 
 void ev_timer_init(ev_timer_t *timer, ev_timer_cb callback, double after, double repeat);
@@ -111,19 +280,356 @@ void ev_timer_again(ev_loop_t *loop, ev_timer_t *timer);
 /**
  *
  *
- * Backend Related Functions (Epoll , Kqueue , Io_Uring)
+ * Prepare / Check / Idle Related Functions
+ *
+ * Prepare watchers run at the start of every iteration, right before the
+ * loop polls. Check watchers run at its end, after every I/O, timer and
+ * completion callback of the iteration, which makes them the place to flush
+ * work those callbacks batched up. Neither keeps the loop alive.
+ * Idle watchers run only in iterations where nothing else was ready, and
+ * while one is started the loop polls without blocking.
+ *
+ *
+ */
+typedef void (*ev_prepare_cb)(ev_prepare_t *watcher, int revents);
+struct ev_prepare
+{
+    int type;
+    ev_prepare_cb callback; // Callback function
+    void *data;             // User data
+    bool active;            // Watcher is started
+    int index;              // Slot in the loop's prepare list, -1 if inactive (internal)
+};
+
+typedef void (*ev_check_cb)(ev_check_t *watcher, int revents);
+struct ev_check
+{
+    int type;
+    ev_check_cb callback; // Callback function
+    void *data;           // User data
+    bool active;          // Watcher is started
+    int index;            // Slot in the loop's check list, -1 if inactive (internal)
+};
+
+typedef void (*ev_idle_cb)(ev_idle_t *watcher, int revents);
+struct ev_idle
+{
+    int type;
+    ev_idle_cb callback; // Callback function
+    void *data;          // User data
+    bool active;         // Watcher is started
+    int index;           // Slot in the loop's idle list, -1 if inactive (internal)
+};
+
+void ev_prepare_init(ev_prepare_t *watcher, ev_prepare_cb callback);
+void ev_prepare_start(ev_loop_t *loop, ev_prepare_t *watcher);
+void ev_prepare_stop(ev_loop_t *loop, ev_prepare_t *watcher);
+void ev_check_init(ev_check_t *watcher, ev_check_cb callback);
+void ev_check_start(ev_loop_t *loop, ev_check_t *watcher);
+void ev_check_stop(ev_loop_t *loop, ev_check_t *watcher);
+void ev_idle_init(ev_idle_t *watcher, ev_idle_cb callback);
+void ev_idle_start(ev_loop_t *loop, ev_idle_t *watcher);
+void ev_idle_stop(ev_loop_t *loop, ev_idle_t *watcher);
+
+/**
+ *
+ *
+ * Fork Related Functions
+ *
+ * Fork watchers are called in the child at the start of the first iteration
+ * after ev_loop_fork, before any prepare watcher. They don't keep the loop
+ * alive. Requests in flight and buffer pools registered with io_uring stay
+ * with the parent, and thread pool workers are not forked: a child that
+ * needs them creates a fresh loop instead.
+ *
+ *
+ */
+typedef void (*ev_fork_cb)(ev_fork_t *watcher, int revents);
+struct ev_fork
+{
+    int type;
+    ev_fork_cb callback; // Callback function
+    void *data;          // User data
+    bool active;         // Watcher is started
+    int index;           // Slot in the loop's fork list, -1 if inactive (internal)
+};
+
+void ev_fork_init(ev_fork_t *watcher, ev_fork_cb callback);
+void ev_fork_start(ev_loop_t *loop, ev_fork_t *watcher);
+void ev_fork_stop(ev_loop_t *loop, ev_fork_t *watcher);
+
+/**
+ *
+ *
+ * Signal Related Functions
+ *
+ * Signal callbacks run in the loop like any other watcher, not in a signal
+ * handler, so they may do anything. Signals raised several times between two
+ * polls are reported once. A signal number can be watched by one loop at a
+ * time; on Linux it is blocked in the thread that starts the watcher and
+ * must stay blocked in every other thread.
+ *
+ *
+ */
+typedef void (*ev_signal_cb)(ev_signal_t *watcher, int revents);
+struct ev_signal
+{
+    int type;
+    int signum;            // Signal to watch (e.g., SIGTERM)
+    ev_signal_cb callback; // Callback function
+    void *data;            // User data
+    bool active;           // Watcher is started
+    ev_signal_t *next;     // Next watcher of the same signal (internal)
+};
+
+void ev_signal_init(ev_signal_t *watcher, ev_signal_cb callback, int signum);
+void ev_signal_start(ev_loop_t *loop, ev_signal_t *watcher);
+void ev_signal_stop(ev_loop_t *loop, ev_signal_t *watcher);
+
+/**
+ *
+ *
+ * Cross Thread Related Functions
+ *
+ * ev_async_send and ev_loop_post are the only calls that may be made on a
+ * loop from another thread. ev_async_send is also safe in a signal handler.
+ * Sends and posts coalesce into one wakeup until the loop has handled it:
+ * an async watcher sent many times is called once, posted tasks run in
+ * posting order in the next batch the loop drains. A started async watcher
+ * keeps the loop alive, posted tasks alone do not.
+ *
+ *
+ */
+typedef void (*ev_async_cb)(ev_async_t *watcher, int revents);
+struct ev_async
+{
+    int type;
+    ev_async_cb callback; // Callback function
+    void *data;           // User data
+    bool active;          // Watcher is started
+    int pending;          // Sent and not yet called back (internal)
+    int index;            // Slot in the loop's async list, -1 if inactive (internal)
+};
+
+void ev_async_init(ev_async_t *watcher, ev_async_cb callback);
+void ev_async_start(ev_loop_t *loop, ev_async_t *watcher);
+void ev_async_stop(ev_loop_t *loop, ev_async_t *watcher);
+void ev_async_send(ev_loop_t *loop, ev_async_t *watcher);
+bool ev_async_pending(ev_async_t *watcher);
+
+typedef void (*ev_task_fn)(void *data);
+struct ev_task
+{
+    ev_task_fn fn;    // Runs on the loop thread
+    void *data;       // Argument of fn
+    ev_task_t *next;  // Queue link (internal)
+};
+
+void ev_task_init(ev_task_t *task, ev_task_fn fn, void *data);
+// The task must stay valid until fn runs, fn may free or re-post it
+void ev_loop_post(ev_loop_t *loop, ev_task_t *task);
+
+/**
+ *
+ *
+ * Thread Pool Related Functions
+ *
+ * ev_work_submit runs `work_fn` on a shared pool of worker threads and then
+ * `done_cb` on the submitting loop's thread, with 0 or -ETIMEDOUT when the
+ * item waited longer than the loop's `work_max_wait` and was never run.
+ * Submitting beyond the loop's `work_queue_depth` fails with -EAGAIN. Items
+ * in flight keep the loop alive. The pool has 4 workers unless sized with
+ * ev_work_pool_init before its first use.
+ *
+ *
+ */
+typedef void (*ev_work_fn)(ev_work_t *work);
+typedef void (*ev_work_done_cb)(ev_work_t *work, int status);
+struct ev_work
+{
+    int type;
+    ev_work_fn work;      // Runs on a pool thread
+    ev_work_done_cb done; // Runs on the loop thread afterwards
+    void *data;           // User data
+    bool active;          // Submitted and done not yet called
+    ev_loop_t *loop;      // Loop done is delivered to (internal)
+    double deadline;      // Shed if not started by then, 0 for never (internal)
+    int status;           // Status handed to done (internal)
+    ev_work_t *next;      // Pool queue link (internal)
+    ev_task_t task;       // Delivery back to the loop (internal)
+};
+
+int ev_work_submit(ev_loop_t *loop, ev_work_t *work, ev_work_fn work_fn, ev_work_done_cb done_cb);
+int ev_work_pool_init(int threads);
+
+/**
+ *
+ *
+ * Async Request Related Functions
+ *
+ * Completion based I/O: the loop performs the operation itself and calls back
+ * with its result (bytes, new fd or 0 on success, -errno on failure). The
+ * request and the memory it points to must stay valid until the callback.
+ * io_uring submits the operation natively, epoll/kqueue try it right away
+ * and fall back to waiting for readiness, which needs a non-blocking fd; the
+ * first request on an fd switches it, later ones on the same fd don't check.
+ * Set a request up once with ev_req_init (or zero it) before its first use,
+ * it can then be submitted again from its callback. Submitting a request
+ * still in flight fails with -EBUSY and leaves it as it was.
+ *
+ *
+ */
+typedef void (*ev_req_cb)(ev_req_t *req, int result);
+struct ev_req
+{
+    int type;
+    int op;                   // EV_OP_*
+    int fd;                   // File descriptor the operation runs on
+    void *buf;                // Read/write buffer
+    size_t len;               // Buffer length
+    struct sockaddr *addr;    // Accept: peer address out, connect: address in
+    socklen_t *addrlen;       // Accept: address length in/out
+    socklen_t addr_size;      // Connect: address length
+    const struct msghdr *msg; // Sendmsg: message
+    int flags;                // Sendmsg: MSG_* flags
+    ev_buf_pool_t *pool;      // Pooled read: pool the buffer is borrowed from
+    ev_req_cb callback;       // Completion callback
+    void *data;               // User data
+    bool active;              // Request is in flight
+    ev_loop_t *loop;          // Loop the request was submitted to (internal)
+    ev_req_t *next;           // Completion queue link (internal)
+    int result;               // Result awaiting delivery (internal)
+    bool zc_notify;           // Zero-copy send done, waiting for buf release (internal)
+    ev_io_t io;               // Readiness watcher of the emulation (internal)
+};
+
+void ev_req_init(ev_req_t *req);
+int ev_read_async(ev_loop_t *loop, ev_req_t *req, int fd, void *buf, size_t len, ev_req_cb callback);
+int ev_write_async(ev_loop_t *loop, ev_req_t *req, int fd, const void *buf, size_t len, ev_req_cb callback);
+int ev_accept_async(ev_loop_t *loop, ev_req_t *req, int fd, struct sockaddr *addr, socklen_t *addrlen, ev_req_cb callback);
+int ev_connect_async(ev_loop_t *loop, ev_req_t *req, int fd, const struct sockaddr *addr, socklen_t addrlen, ev_req_cb callback);
+int ev_sendmsg_async(ev_loop_t *loop, ev_req_t *req, int fd, const struct msghdr *msg, int flags, ev_req_cb callback);
+// Zero-copy send: the callback runs with the send result once the kernel no
+// longer references `buf`. Keep at most one in flight per socket.
+int ev_send_zc_async(ev_loop_t *loop, ev_req_t *req, int fd, const void *buf, size_t len, ev_req_cb callback);
+
+/**
+ *
+ *
+ * Buffer Pool Related Functions
+ *
+ * A pooled read holds no memory while the fd is idle. A buffer is picked
+ * from the pool only once data is there (by the kernel from a provided
+ * buffer ring on io_uring, by the loop on readiness elsewhere) and handed to
+ * the callback in `req->buf`. The callback borrows it and must give it back
+ * with ev_buf_release. An empty pool completes the read with -ENOBUFS.
+ *
+ *
+ */
+struct ev_buf_pool
+{
+    char *base;          // One allocation holding every buffer
+    size_t buf_size;     // Size of each buffer, rounded to a cache line
+    unsigned count;      // Number of buffers, a power of two
+    unsigned *free_ids;  // Idle buffer ids (pools not owned by the kernel)
+    unsigned free_count; // Entries on the free_ids stack
+    int group;           // Provided-buffer group id, -1 when managed by the loop
+    void *ring;          // Backend buffer ring (internal)
+    ev_loop_t *loop;     // Loop the pool belongs to
+};
+
+ev_buf_pool_t *ev_buf_pool_create(ev_loop_t *loop, size_t buf_size, unsigned count);
+void ev_buf_pool_destroy(ev_buf_pool_t *pool);
+void ev_buf_release(ev_buf_pool_t *pool, void *buf);
+int ev_read_pooled_async(ev_loop_t *loop, ev_req_t *req, int fd, ev_buf_pool_t *pool, ev_req_cb callback);
+
+/**
+ *
+ *
+ * Object Pool Related Functions
+ *
+ * A slab allocator for connection and watcher objects. A pool serves objects
+ * of up to the size it was created with (at most 16 KB) from power-of-two
+ * size classes, every object cache-line aligned. It belongs to the thread
+ * that created it: only that thread may allocate, without taking a lock;
+ * any thread may free into it. Memory goes back to the system only with
+ * ev_pool_destroy.
+ *
+ * ev_loop_pool is the loop's own pool (objects up to 16 KB), made on first
+ * use and destroyed with the loop. It belongs to the thread running the loop,
+ * ev_run takes it over, so allocate from it in the loop's callbacks only.
+ *
+ *
+ */
+ev_pool_t *ev_pool_create(size_t size);
+void ev_pool_destroy(ev_pool_t *pool);
+// NULL if `size` is over the pool's size or memory ran out
+void *ev_pool_alloc(ev_pool_t *pool, size_t size);
+void ev_pool_free(ev_pool_t *pool, void *ptr);
+ev_pool_t *ev_loop_pool(ev_loop_t *loop);
+
+/**
+ *
+ *
+ * Runtime Related Functions
+ *
+ * A runtime runs N independent loops on N threads, pinned to N CPUs where
+ * the platform allows it. `setup` runs on every loop's own thread before
+ * that loop starts, it is where the loop's watchers get started. With a
+ * `listen_addr` every loop also gets its own SO_REUSEPORT listening socket
+ * (`listen_fd`, -1 otherwise) which the runtime closes on destroy.
+ * Watchers of a runtime loop must only be touched from that loop's thread;
+ * callbacks find their loop with ev_current_loop.
+ *
+ *
+ */
+typedef void (*ev_runtime_setup_cb)(ev_loop_t *loop, int index, int listen_fd, void *data);
+struct ev_runtime_options
+{
+    int threads;                        // Loops to run, 0 for one per usable CPU
+    bool pin;                           // Pin loop i to the i-th usable CPU
+    const struct sockaddr *listen_addr; // Address every loop listens on, NULL for none
+    socklen_t listen_addrlen;           // Length of listen_addr
+    int backlog;                        // listen() backlog of each socket
+    ev_loop_options_t loop;             // Options every loop is created with
+    ev_runtime_setup_cb setup;          // Called on each loop's thread before it runs
+    void *data;                         // User data passed to setup
+};
+
+void ev_runtime_options_init(ev_runtime_options_t *options);
+ev_runtime_t *ev_runtime_create(const ev_runtime_options_t *options);
+int ev_runtime_start(ev_runtime_t *runtime);
+void ev_runtime_stop(ev_runtime_t *runtime);
+void ev_runtime_join(ev_runtime_t *runtime);
+void ev_runtime_destroy(ev_runtime_t *runtime);
+int ev_runtime_size(ev_runtime_t *runtime);
+ev_loop_t *ev_runtime_loop(ev_runtime_t *runtime, int index);
+int ev_listen_reuseport(const struct sockaddr *addr, socklen_t addrlen, int backlog);
+
+/**
+ *
+ *
+ * Backend Related Functions (Epoll , Kqueue , Io_Uring , Poll)
  *
  *
  */
-ev_backend_t *ev_backend_init();
+ev_backend_t *ev_backend_init(const ev_loop_options_t *options);
 void ev_backend_destroy(ev_backend_t *backend);
 void ev_backend_prepare(ev_backend_t *backend);
-int ev_backend_poll(ev_backend_t *backend, int flags);
-void ev_backend_dispatch(ev_backend_t *backend);
+int ev_backend_poll(ev_backend_t *backend, int timeout);
+void ev_backend_dispatch(ev_backend_t *backend, int ready, ev_pending_queue_t *pending);
 int ev_backend_is_empty(ev_backend_t *backend);
+int ev_backend_active_count(ev_backend_t *backend);
 void ev_backend_register_io(ev_backend_t *backend, ev_io_t *watcher);
 void ev_backend_unregister_io(ev_backend_t *backend, ev_io_t *watcher);
-int ev_backend_register_timer(ev_backend_t *backend, ev_timer_t *timer);
-int ev_backend_unregister_timer(ev_backend_t *backend, ev_timer_t *timer);
+void ev_backend_modify_io(ev_backend_t *backend, ev_io_t *watcher, int events);
+int ev_backend_submit(ev_backend_t *backend, ev_req_t *req);
+int ev_backend_buf_pool_register(ev_backend_t *backend, ev_buf_pool_t *pool);
+void ev_backend_buf_pool_unregister(ev_backend_t *backend, ev_buf_pool_t *pool);
+void ev_backend_buf_pool_recycle(ev_backend_t *backend, ev_buf_pool_t *pool, unsigned id);
+int ev_backend_notify(ev_backend_t *backend, ev_backend_t *target, ev_io_t *watcher);
+int ev_backend_signal(ev_backend_t *backend, int signum, bool enable, ev_io_t *watcher);
+int ev_backend_kind(ev_backend_t *backend);
+const char *ev_backend_name(ev_backend_t *backend);
 
 #endif // LIB_EKIO_H
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include "libekio.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+
+#if HAVE_LINUX
+#include <sys/eventfd.h>
+#endif
+
+/*
+ * Cross-thread wakeups.
+ *
+ * Every loop owns one wakeup fd (an eventfd on Linux, a pipe elsewhere)
+ * watched by an internal ev_io watcher. Other threads never touch loop state
+ * directly: they flag an ev_async_t or push an ev_task_t and then wake the
+ * loop. The `pending` flag coalesces wakeups, only the first sender after the
+ * loop last drained the fd pays for the write, so a burst costs one syscall
+ * on each side however many tasks it carries.
+ *
+ * Posted tasks go on a lock-free multi-producer stack: producers push with a
+ * CAS on the head, the loop takes the whole stack with one exchange and
+ * reverses it to run the batch in posting order. Because the consumer never
+ * pops single nodes there is no ABA problem to guard against.
+ *
+ * A sender still touches the wakeup after its task became visible, when the
+ * loop may already have run it and be on its way out. Senders are counted
+ * and ev_loop_destroy waits for them to leave.
+ */
+
+typedef struct ev_task_queue
+{
+    ev_task_t *head; // Most recently posted task
+} ev_task_queue_t;
+
+static void ev_task_queue_init(ev_task_queue_t *queue)
+{
+    queue->head = NULL;
+}
+
+// Multi-producer push, safe from any thread
+static void ev_task_queue_push(ev_task_queue_t *queue, ev_task_t *task)
+{
+    ev_task_t *head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    do
+    {
+        task->next = head;
+    } while (!__atomic_compare_exchange_n(&queue->head, &head, task, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// Single consumer: take every queued task, oldest first
+static ev_task_t *ev_task_queue_take(ev_task_queue_t *queue)
+{
+    ev_task_t *task = __atomic_exchange_n(&queue->head, NULL, __ATOMIC_ACQUIRE);
+    ev_task_t *batch = NULL;
+
+    while (task)
+    {
+        ev_task_t *next = task->next;
+        task->next = batch;
+        batch = task;
+        task = next;
+    }
+    return batch;
+}
+
+typedef struct ev_wake
+{
+    int fds[2];     // Read and write end, the same eventfd twice on Linux
+    int pending;    // A wakeup was sent and not yet consumed by the loop
+    int senders;    // Threads inside a send or post to this loop
+    ev_io_t watcher;
+} ev_wake_t;
+
+static int ev_wake_init(ev_wake_t *wake)
+{
+    wake->pending = 0;
+    wake->senders = 0;
+#if HAVE_LINUX
+    wake->fds[0] = wake->fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake->fds[0] == -1)
+    {
+        perror("Failed to create wakeup eventfd");
+        return -1;
+    }
+#else
+    if (pipe(wake->fds) == -1)
+    {
+        perror("Failed to create wakeup pipe");
+        return -1;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        fcntl(wake->fds[i], F_SETFL, fcntl(wake->fds[i], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(wake->fds[i], F_SETFD, FD_CLOEXEC);
+    }
+#endif
+    return 0;
+}
+
+static inline void ev_wake_enter(ev_wake_t *wake)
+{
+    __atomic_add_fetch(&wake->senders, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline void ev_wake_leave(ev_wake_t *wake)
+{
+    __atomic_sub_fetch(&wake->senders, 1, __ATOMIC_RELEASE);
+}
+
+static void ev_wake_destroy(ev_wake_t *wake)
+{
+    while (__atomic_load_n(&wake->senders, __ATOMIC_ACQUIRE) > 0)
+        sched_yield();
+
+    close(wake->fds[0]);
+    if (wake->fds[1] != wake->fds[0])
+        close(wake->fds[1]);
+}
+
+// Child side of fork: the inherited fd is shared with the parent's loop and
+// the threads counted as senders don't exist here
+static int ev_wake_fork(ev_wake_t *wake)
+{
+    close(wake->fds[0]);
+    if (wake->fds[1] != wake->fds[0])
+        close(wake->fds[1]);
+    return ev_wake_init(wake);
+}
+
+// Claim the wakeup, false if one is already on its way to the loop
+static inline bool ev_wake_claim(ev_wake_t *wake)
+{
+    return __atomic_exchange_n(&wake->pending, 1, __ATOMIC_SEQ_CST) == 0;
+}
+
+// Write to the wakeup fd, async-signal-safe
+static void ev_wake_signal(ev_wake_t *wake)
+{
+#if HAVE_LINUX
+    uint64_t one = 1;
+    ssize_t ret = write(wake->fds[1], &one, sizeof(one));
+#else
+    ssize_t ret = write(wake->fds[1], "", 1);
+#endif
+    (void)ret; // A full pipe or counter already wakes the loop
+}
+
+// Loop side: empty the fd, then re-open the wakeup, before looking for work.
+// Draining after the reset would swallow the write of a sender that claimed
+// the wakeup in between, and with nothing else pending the loop would sleep
+// on the work that sender just queued.
+static void ev_wake_consume(ev_wake_t *wake, bool drain)
+{
+    if (drain)
+    {
+        char buf[64];
+        while (read(wake->fds[0], buf, sizeof(buf)) > 0)
+            ;
+    }
+    __atomic_store_n(&wake->pending, 0, __ATOMIC_SEQ_CST);
+}
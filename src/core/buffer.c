@@ -0,0 +1,81 @@
+#include "libekio.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Receive buffer pools.
+ *
+ * All buffers of a pool are carved out of one cache-line aligned block so a
+ * buffer is identified by its index, which is also the buffer id io_uring
+ * reports for provided buffers. Pools the backend cannot hand to the kernel
+ * keep their idle ids on a LIFO stack, so the most recently used (and
+ * cache-warm) buffer is reused first.
+ */
+
+static inline unsigned ev_buf_pool_round_count(unsigned count)
+{
+    unsigned rounded = 1;
+    while (rounded < count)
+        rounded <<= 1;
+    return rounded;
+}
+
+static int ev_buf_pool_alloc(ev_buf_pool_t *pool, size_t buf_size, unsigned count)
+{
+    pool->buf_size = (buf_size + EV_CACHE_LINE - 1) & ~(size_t)(EV_CACHE_LINE - 1);
+    pool->count = ev_buf_pool_round_count(count);
+    pool->free_count = 0;
+    pool->group = -1;
+    pool->ring = NULL;
+
+    if (posix_memalign((void **)&pool->base, EV_CACHE_LINE, pool->buf_size * pool->count) != 0)
+    {
+        perror("Failed to allocate buffer pool");
+        return -1;
+    }
+
+    pool->free_ids = (unsigned *)malloc(sizeof(unsigned) * pool->count);
+    if (!pool->free_ids)
+    {
+        perror("Failed to allocate buffer pool ids");
+        free(pool->base);
+        return -1;
+    }
+
+    // Push in reverse so the first buffers handed out are the lowest addresses
+    for (unsigned id = pool->count; id > 0; id--)
+    {
+        pool->free_ids[pool->free_count++] = id - 1;
+    }
+    return 0;
+}
+
+static void ev_buf_pool_free(ev_buf_pool_t *pool)
+{
+    free(pool->base);
+    free(pool->free_ids);
+}
+
+static inline void *ev_buf_pool_addr(ev_buf_pool_t *pool, unsigned id)
+{
+    return pool->base + (size_t)id * pool->buf_size;
+}
+
+static inline unsigned ev_buf_pool_id(ev_buf_pool_t *pool, void *buf)
+{
+    return (unsigned)(((char *)buf - pool->base) / pool->buf_size);
+}
+
+// Borrow an idle buffer from a loop-managed pool, NULL when exhausted
+static void *ev_buf_pool_take(ev_buf_pool_t *pool)
+{
+    if (pool->free_count == 0)
+        return NULL;
+    return ev_buf_pool_addr(pool, pool->free_ids[--pool->free_count]);
+}
+
+static void ev_buf_pool_put(ev_buf_pool_t *pool, void *buf)
+{
+    pool->free_ids[pool->free_count++] = ev_buf_pool_id(pool, buf);
+}
@@ -0,0 +1,242 @@
+#include "libekio.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Loop-wide fd table.
+ *
+ * A dense array indexed by fd holds the I/O watchers of every fd, 16 bytes
+ * per fd, so a million fds fit in 16 MB and the lookup is a single load.
+ *
+ * An fd with one watcher hands that watcher to the backend as is, with its
+ * own trigger mode. A second watcher on the fd (a reader next to a writer,
+ * say) turns the fd shared: one internal watcher is registered in their
+ * place with the merged interest, and when it fires the pending queue fans
+ * the event out to each watcher that asked for it. The shared registration
+ * is edge-triggered only if every watcher is, and EV_ONESHOT is done per
+ * watcher by stopping it at fan-out.
+ */
+
+// ev_io_t.type of a shared registration, never seen by user code
+#define FD_SHARED_EVENT 100
+
+typedef struct ev_fd
+{
+    ev_io_t *head;  // Watchers of the fd, linked through next_fd
+    ev_io_t *share; // Registration standing in for them once the fd is shared
+} ev_fd_t;
+
+typedef struct ev_fd_table
+{
+    ev_fd_t *fds;
+    int capacity;          // Entries allocated in fds
+    ev_backend_t *backend; // Where registrations go
+    ev_pool_t *pool;       // Shared registrations come from here, malloc when NULL
+} ev_fd_table_t;
+
+static void ev_fd_table_init(ev_fd_table_t *table, ev_backend_t *backend)
+{
+    table->fds = NULL;
+    table->capacity = 0;
+    table->backend = backend;
+    table->pool = NULL;
+}
+
+static ev_io_t *ev_fd_share_alloc(ev_fd_table_t *table)
+{
+    ev_io_t *share = table->pool ? (ev_io_t *)ev_slab_alloc(table->pool, sizeof(ev_io_t))
+                                 : (ev_io_t *)malloc(sizeof(ev_io_t));
+    if (share)
+        memset(share, 0, sizeof(ev_io_t));
+    return share;
+}
+
+static void ev_fd_share_free(ev_fd_table_t *table, ev_io_t *share)
+{
+    if (share && table->pool)
+        ev_slab_free(table->pool, share);
+    else
+        free(share);
+}
+
+static void ev_fd_table_destroy(ev_fd_table_t *table)
+{
+    for (int fd = 0; fd < table->capacity; fd++)
+        ev_fd_share_free(table, table->fds[fd].share);
+    free(table->fds);
+    ev_fd_table_init(table, NULL);
+}
+
+// Make sure fd has an entry
+static int ev_fd_reserve(ev_fd_table_t *table, int fd)
+{
+    if (fd < 0)
+        return -1;
+    if (fd < table->capacity)
+        return 0;
+
+    int capacity = table->capacity ? table->capacity : 64;
+    while (capacity <= fd)
+        capacity *= 2;
+
+    ev_fd_t *fds = (ev_fd_t *)realloc(table->fds, sizeof(ev_fd_t) * capacity);
+    if (!fds)
+    {
+        perror("Failed to grow fd table");
+        return -1;
+    }
+    memset(fds + table->capacity, 0, sizeof(ev_fd_t) * (capacity - table->capacity));
+
+    table->fds = fds;
+    table->capacity = capacity;
+    return 0;
+}
+
+// Interest of every watcher of the fd in one registration
+static int ev_fd_merge(ev_fd_t *entry)
+{
+    int events = 0;
+    bool edge = true;
+
+    for (ev_io_t *watcher = entry->head; watcher; watcher = watcher->next_fd)
+    {
+        events |= watcher->events & (EV_READ | EV_WRITE);
+        edge = edge && (watcher->events & EV_ET);
+    }
+    return events | (edge ? EV_ET : 0);
+}
+
+// Take a watcher off its fd's list, no-op if it isn't on it
+static void ev_fd_unlink(ev_fd_table_t *table, ev_io_t *watcher)
+{
+    if (watcher->fd < 0 || watcher->fd >= table->capacity)
+        return;
+
+    for (ev_io_t **link = &table->fds[watcher->fd].head; *link; link = &(*link)->next_fd)
+    {
+        if (*link == watcher)
+        {
+            *link = watcher->next_fd;
+            watcher->next_fd = NULL;
+            return;
+        }
+    }
+}
+
+// Register a watcher being started, it stays inactive if that fails
+static void ev_fd_start(ev_fd_table_t *table, ev_io_t *watcher)
+{
+    if (ev_fd_reserve(table, watcher->fd) != 0)
+    {
+        watcher->active = false;
+        return;
+    }
+
+    ev_fd_t *entry = &table->fds[watcher->fd];
+
+    // A one-shot watcher the backend stopped may still wait for its callback
+    ev_fd_unlink(table, watcher);
+    if (entry->head && !entry->share && !entry->head->active)
+        ev_fd_unlink(table, entry->head);
+
+    if (!entry->head)
+    {
+        ev_backend_register_io(table->backend, watcher);
+        if (watcher->active)
+            entry->head = watcher;
+        return;
+    }
+
+    if (!entry->share)
+    {
+        ev_io_t *share = ev_fd_share_alloc(table);
+        if (!share)
+        {
+            perror("Failed to share fd registration");
+            watcher->active = false;
+            return;
+        }
+        share->type = FD_SHARED_EVENT;
+        share->fd = watcher->fd;
+        share->active = true;
+
+        // The lone watcher's own registration makes way for the shared one
+        ev_backend_unregister_io(table->backend, entry->head);
+        entry->share = share;
+        watcher->next_fd = entry->head;
+        entry->head = watcher;
+        share->events = ev_fd_merge(entry);
+        ev_backend_register_io(table->backend, share);
+        return;
+    }
+
+    watcher->next_fd = entry->head;
+    entry->head = watcher;
+    int events = ev_fd_merge(entry);
+    if (events != entry->share->events)
+        ev_backend_modify_io(table->backend, entry->share, events);
+}
+
+// Unregister a watcher that was just marked inactive
+static void ev_fd_stop(ev_fd_table_t *table, ev_io_t *watcher)
+{
+    ev_fd_unlink(table, watcher);
+    if (watcher->fd < 0 || watcher->fd >= table->capacity)
+        return;
+
+    ev_fd_t *entry = &table->fds[watcher->fd];
+    if (!entry->share)
+    {
+        ev_backend_unregister_io(table->backend, watcher);
+        return;
+    }
+
+    if (!entry->head)
+    {
+        ev_backend_unregister_io(table->backend, entry->share);
+        ev_fd_share_free(table, entry->share);
+        entry->share = NULL;
+        return;
+    }
+
+    int events = ev_fd_merge(entry);
+    if (events != entry->share->events)
+        ev_backend_modify_io(table->backend, entry->share, events);
+}
+
+// Change an active watcher's interest
+static void ev_fd_modify(ev_fd_table_t *table, ev_io_t *watcher, int events)
+{
+    ev_fd_t *entry = &table->fds[watcher->fd];
+    if (!entry->share)
+    {
+        ev_backend_modify_io(table->backend, watcher, events);
+        return;
+    }
+
+    watcher->events = events;
+    events = ev_fd_merge(entry);
+    if (events != entry->share->events)
+        ev_backend_modify_io(table->backend, entry->share, events);
+}
+
+// Hand every registration to a new backend (after fork)
+static void ev_fd_table_rebuild(ev_fd_table_t *table, ev_backend_t *backend)
+{
+    table->backend = backend;
+    for (int fd = 0; fd < table->capacity; fd++)
+    {
+        ev_fd_t *entry = &table->fds[fd];
+        if (entry->share)
+        {
+            ev_backend_register_io(backend, entry->share);
+        }
+        else if (entry->head && entry->head->active)
+        {
+            ev_backend_register_io(backend, entry->head);
+            if (!entry->head->active)
+                entry->head = NULL;
+        }
+    }
+}
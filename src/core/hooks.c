@@ -0,0 +1,117 @@
+#include "libekio.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+ * Unordered lists of started watchers that have no fd or deadline of their
+ * own (async, prepare, check, idle). A slot remembers where its watcher
+ * keeps its index, so stop is O(1): the last slot moves into the hole and
+ * its watcher learns its new index.
+ *
+ * While the loop calls back into a list (between ev_hook_list_begin and
+ * ev_hook_list_end) slots don't move: a callback stopping a watcher only
+ * empties its slot, and the holes are closed once the walk is over. Moving
+ * the last slot then could hand a watcher the walk already called to a slot
+ * it has yet to visit. Watchers started by a callback are appended past the
+ * walk's first slot and wait for the next walk.
+ */
+
+typedef struct ev_hook_slot
+{
+    void *watcher; // ev_async_t, ev_prepare_t, ...
+    int *index;    // The watcher's own index field
+} ev_hook_slot_t;
+
+typedef struct ev_hook_list
+{
+    ev_hook_slot_t *slots;
+    int count;    // Started watchers
+    int used;     // Slots in use, count plus the holes left during a walk
+    int capacity; // Allocated slots
+    int walking;  // Walks in progress, nested runs of the loop may add more
+} ev_hook_list_t;
+
+static void ev_hook_list_init(ev_hook_list_t *list)
+{
+    list->slots = NULL;
+    list->count = 0;
+    list->used = 0;
+    list->capacity = 0;
+    list->walking = 0;
+}
+
+static void ev_hook_list_destroy(ev_hook_list_t *list)
+{
+    free(list->slots);
+    ev_hook_list_init(list);
+}
+
+static int ev_hook_list_add(ev_hook_list_t *list, void *watcher, int *index)
+{
+    if (list->used == list->capacity)
+    {
+        int capacity = list->capacity ? list->capacity * 2 : 8;
+        ev_hook_slot_t *slots = (ev_hook_slot_t *)realloc(list->slots, sizeof(ev_hook_slot_t) * capacity);
+        if (!slots)
+        {
+            perror("Failed to grow watcher list");
+            return -1;
+        }
+        list->slots = slots;
+        list->capacity = capacity;
+    }
+
+    *index = list->used;
+    list->slots[list->used].watcher = watcher;
+    list->slots[list->used].index = index;
+    list->used++;
+    list->count++;
+    return 0;
+}
+
+static void ev_hook_list_remove(ev_hook_list_t *list, int *index)
+{
+    list->count--;
+    if (list->walking)
+    {
+        list->slots[*index].watcher = NULL;
+        *index = -1;
+        return;
+    }
+
+    ev_hook_slot_t last = list->slots[--list->used];
+    list->slots[*index] = last;
+    *last.index = *index;
+    *index = -1;
+}
+
+// Start a walk from the end, returns its first slot
+static inline int ev_hook_list_begin(ev_hook_list_t *list)
+{
+    list->walking++;
+    return list->used - 1;
+}
+
+// Watcher in slot `i` of the walk, NULL for a watcher stopped meanwhile
+static inline void *ev_hook_list_at(ev_hook_list_t *list, int i)
+{
+    return list->slots[i].watcher;
+}
+
+// End a walk, the last one out closes the holes stops left behind
+static void ev_hook_list_end(ev_hook_list_t *list)
+{
+    if (--list->walking > 0 || list->used == list->count)
+        return;
+
+    int used = 0;
+    for (int i = 0; i < list->used; i++)
+    {
+        if (!list->slots[i].watcher)
+            continue;
+        list->slots[used] = list->slots[i];
+        *list->slots[used].index = used;
+        used++;
+    }
+    list->used = used;
+}
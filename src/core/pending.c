@@ -0,0 +1,226 @@
+#include "libekio.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+ * Pending I/O callbacks, ordered by watcher priority.
+ *
+ * Backends no longer call I/O watchers while walking the kernel's ready list.
+ * They feed each ready watcher into the queue of its priority and the loop
+ * runs the queues from EV_MAXPRI down, so a flood on bulk sockets can't
+ * delay a health check that became ready in the same poll.
+ *
+ * A priority can be given a budget of callbacks per iteration. Whatever is
+ * over the budget stays queued for the next iteration, and the loop polls
+ * without blocking while anything is queued, so it keeps coming back to the
+ * kernel (and to higher priorities) at a bounded rate under load. A watcher
+ * reported again while still queued keeps its place, its events are merged.
+ *
+ * A watcher's `pending` is its slot in the queue plus one, stopping a queued
+ * watcher empties the slot so its memory can be released right away.
+ *
+ * Backends report an fd shared by several watchers through its one shared
+ * registration; feeding that queues each watcher that asked for the event.
+ */
+
+#define EV_PRIORITY_LEVELS (EV_MAXPRI - EV_MINPRI + 1)
+
+// Or'ed into `ready` by the backends when the fd reported an error. Every
+// watcher of the fd hears about it, whatever it asked for: a zero-copy send
+// waits for its completion with no interest at all.
+#define EV_READY_ERROR 0x8000
+
+typedef struct ev_pending
+{
+    ev_io_t *watcher; // NULL once the watcher was stopped
+    int revents;
+} ev_pending_t;
+
+typedef struct ev_pending_level
+{
+    ev_pending_t *entries;
+    int count;    // Slots used, including emptied ones
+    int capacity; // Slots allocated
+    int budget;   // Callbacks per iteration, 0 for no limit
+} ev_pending_level_t;
+
+struct ev_pending_queue
+{
+    ev_pending_level_t levels[EV_PRIORITY_LEVELS]; // Indexed by priority - EV_MINPRI
+    int count;                                     // Watchers waiting in any level
+    bool running;                                  // ev_pending_run is calling back
+    ev_fd_table_t *fds;                            // The loop's watchers by fd
+};
+
+static void ev_pending_queue_init(ev_pending_queue_t *queue, ev_fd_table_t *fds)
+{
+    for (int i = 0; i < EV_PRIORITY_LEVELS; i++)
+    {
+        queue->levels[i].entries = NULL;
+        queue->levels[i].count = 0;
+        queue->levels[i].capacity = 0;
+        queue->levels[i].budget = 0;
+    }
+    queue->count = 0;
+    queue->running = false;
+    queue->fds = fds;
+}
+
+static void ev_pending_queue_destroy(ev_pending_queue_t *queue)
+{
+    for (int i = 0; i < EV_PRIORITY_LEVELS; i++)
+    {
+        ev_pending_level_t *level = &queue->levels[i];
+        for (int j = 0; j < level->count; j++)
+        {
+            if (level->entries[j].watcher)
+                level->entries[j].watcher->pending = 0;
+        }
+        free(level->entries);
+    }
+    ev_pending_queue_init(queue, queue->fds);
+}
+
+static void ev_pending_call(ev_pending_queue_t *queue, ev_io_t *watcher, int revents)
+{
+    // The backend already stopped a one-shot watcher, forget it before its
+    // callback may free it
+    if (!watcher->active)
+        ev_fd_unlink(queue->fds, watcher);
+
+    watcher->callback(watcher, revents);
+}
+
+static void ev_pending_add(ev_pending_queue_t *queue, ev_io_t *watcher, int revents)
+{
+    ev_pending_level_t *level = &queue->levels[watcher->priority - EV_MINPRI];
+
+    if (watcher->pending)
+    {
+        level->entries[watcher->pending - 1].revents |= revents;
+        return;
+    }
+
+    if (level->count == level->capacity)
+    {
+        int capacity = level->capacity ? level->capacity * 2 : 64;
+        ev_pending_t *entries = (ev_pending_t *)realloc(level->entries, sizeof(ev_pending_t) * capacity);
+        if (!entries)
+        {
+            // Better out of order than lost
+            perror("Failed to grow pending queue");
+            ev_pending_call(queue, watcher, revents);
+            return;
+        }
+        level->entries = entries;
+        level->capacity = capacity;
+    }
+
+    level->entries[level->count].watcher = watcher;
+    level->entries[level->count].revents = revents;
+    watcher->pending = ++level->count;
+    queue->count++;
+}
+
+// A shared fd is ready, queue each of its watchers interested in `ready`,
+// or all of them on an error
+static void ev_pending_fan_out(ev_pending_queue_t *queue, int fd, int revents, int ready)
+{
+    ev_io_t *watcher = queue->fds->fds[fd].head;
+    while (watcher)
+    {
+        ev_io_t *next = watcher->next_fd;
+        if (watcher->active && ((watcher->events & ready) || (ready & EV_READY_ERROR)))
+        {
+            // The shared registration stays armed, one-shot is up to us
+            if (watcher->events & EV_ONESHOT)
+            {
+                watcher->active = false;
+                ev_fd_stop(queue->fds, watcher);
+            }
+            ev_pending_add(queue, watcher, revents);
+        }
+        watcher = next;
+    }
+}
+
+// Queue a ready watcher, called by the backends while dispatching. `ready` is
+// the EV_READ / EV_WRITE meaning of the backend's `revents`, plus
+// EV_READY_ERROR if it carries an error.
+static void ev_pending_feed(ev_pending_queue_t *queue, ev_io_t *watcher, int revents, int ready)
+{
+    if (watcher->type == FD_SHARED_EVENT)
+        ev_pending_fan_out(queue, watcher->fd, revents, ready);
+    else
+        ev_pending_add(queue, watcher, revents);
+}
+
+// Forget a queued watcher, it is being stopped
+static void ev_pending_clear(ev_pending_queue_t *queue, ev_io_t *watcher)
+{
+    if (!watcher->pending)
+        return;
+
+    ev_pending_level_t *level = &queue->levels[watcher->priority - EV_MINPRI];
+    level->entries[watcher->pending - 1].watcher = NULL;
+    watcher->pending = 0;
+    queue->count--;
+}
+
+// Run one level up to its budget, then move what is left to the front
+static int ev_pending_run_level(ev_pending_queue_t *queue, ev_pending_level_t *level, ev_probe_t *probe)
+{
+    int calls = 0;
+    int i = 0;
+
+    while (i < level->count && (level->budget == 0 || calls < level->budget))
+    {
+        // Index every time, a callback may stop watchers queued after this one
+        ev_pending_t entry = level->entries[i++];
+        if (!entry.watcher)
+            continue;
+
+        entry.watcher->pending = 0;
+        level->entries[i - 1].watcher = NULL;
+        queue->count--;
+        calls++;
+
+        if (!ev_probe_active(probe))
+        {
+            ev_pending_call(queue, entry.watcher, entry.revents);
+            continue;
+        }
+        ev_io_t *watcher = entry.watcher;
+        double start = ev_probe_enter(probe, watcher->type, watcher->fd, watcher, (const void *)watcher->callback);
+        ev_pending_call(queue, watcher, entry.revents);
+        ev_probe_leave(probe, start);
+    }
+
+    int left = 0;
+    for (; i < level->count; i++)
+    {
+        ev_pending_t entry = level->entries[i];
+        if (!entry.watcher)
+            continue;
+        level->entries[left] = entry;
+        entry.watcher->pending = ++left;
+    }
+    level->count = left;
+    return calls;
+}
+
+// Call queued watchers, highest priority first, returns the number of callbacks.
+// Each callback is wrapped in `probe` (metrics, watchdog heartbeat).
+static int ev_pending_run(ev_pending_queue_t *queue, ev_probe_t *probe)
+{
+    // A nested ev_run leaves the queue to the outer one
+    if (queue->count == 0 || queue->running)
+        return 0;
+
+    int calls = 0;
+    queue->running = true;
+    for (int i = EV_PRIORITY_LEVELS - 1; i >= 0; i--)
+        calls += ev_pending_run_level(queue, &queue->levels[i], probe);
+    queue->running = false;
+    return calls;
+}
@@ -0,0 +1,252 @@
+#include "libekio.h"
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#if HAVE_LINUX
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#endif
+
+// MSG_ZEROCOPY with completions on the socket error queue (Linux 4.14+)
+#if HAVE_LINUX && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#define EV_HAVE_MSG_ZEROCOPY 1
+#else
+#define EV_HAVE_MSG_ZEROCOPY 0
+#endif
+
+/*
+ * Completion request emulation for readiness backends (epoll, kqueue).
+ *
+ * A request is tried once right away; most writes and many reads finish
+ * there and only cost the one syscall. Otherwise the request parks an
+ * internal ev_io watcher and retries when the fd becomes ready. Requests
+ * that finished without waiting are queued and their callbacks run from
+ * the loop, so a callback never runs inside the submitting call.
+ *
+ * A zero-copy send is done in two steps: the MSG_ZEROCOPY send itself, then
+ * waiting with an empty interest set (epoll still reports EPOLLERR) until
+ * the kernel posts the release notification on the socket's error queue.
+ */
+
+typedef struct ev_req_queue
+{
+    ev_req_t *head;
+    ev_req_t *tail;
+    int count;
+} ev_req_queue_t;
+
+static void ev_req_queue_init(ev_req_queue_t *queue)
+{
+    queue->head = NULL;
+    queue->tail = NULL;
+    queue->count = 0;
+}
+
+static void ev_req_queue_push(ev_req_queue_t *queue, ev_req_t *req)
+{
+    req->next = NULL;
+    if (queue->tail)
+        queue->tail->next = req;
+    else
+        queue->head = req;
+    queue->tail = req;
+    queue->count++;
+}
+
+// Deliver queued completions; callbacks may submit again, those wait for the next run
+static void ev_req_queue_run(ev_req_queue_t *queue)
+{
+    ev_req_t *req = queue->head;
+
+    queue->head = NULL;
+    queue->tail = NULL;
+    queue->count = 0;
+
+    while (req)
+    {
+        ev_req_t *next = req->next;
+        req->active = false;
+        req->callback(req, req->result);
+        req = next;
+    }
+}
+
+#if EV_HAVE_MSG_ZEROCOPY
+// Read one error queue entry, returns the send result once our buffer is released
+static int ev_req_zc_reap(ev_req_t *req)
+{
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + CMSG_SPACE(sizeof(struct sockaddr_in6))];
+    struct msghdr msg = {0};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(req->fd, &msg, MSG_ERRQUEUE) == -1)
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? -EAGAIN : -errno;
+
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+    {
+        if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+              (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+            continue;
+
+        struct sock_extended_err *err = (struct sock_extended_err *)CMSG_DATA(cm);
+        if (err->ee_origin == SO_EE_ORIGIN_ZEROCOPY)
+            return req->result; // Only one send in flight, any notification is ours
+        if (err->ee_errno)
+            return -(int)err->ee_errno;
+    }
+    return -EAGAIN;
+}
+#endif
+
+static int ev_req_send_zc(ev_req_t *req)
+{
+#if EV_HAVE_MSG_ZEROCOPY
+    if (req->zc_notify)
+        return ev_req_zc_reap(req);
+
+    // First attempt: opt the socket in, fall back to a copying send if it can't
+    if (!req->io.active)
+    {
+        int zerocopy = 1;
+        bool enabled = setsockopt(req->fd, SOL_SOCKET, SO_ZEROCOPY, &zerocopy, sizeof(zerocopy)) == 0;
+        req->flags = enabled ? MSG_ZEROCOPY : 0;
+    }
+
+    ssize_t ret = send(req->fd, req->buf, req->len, req->flags);
+    if (ret == -1)
+        return (errno == EWOULDBLOCK) ? -EAGAIN : -errno;
+    if (!(req->flags & MSG_ZEROCOPY) || ret == 0)
+        return (int)ret;
+
+    // The kernel still references buf, wait for its notification
+    req->result = (int)ret;
+    req->zc_notify = true;
+    return ev_req_zc_reap(req);
+#else
+    ssize_t ret = send(req->fd, req->buf, req->len, 0);
+    if (ret == -1)
+        return (errno == EWOULDBLOCK) ? -EAGAIN : -errno;
+    return (int)ret;
+#endif
+}
+
+// Run the operation once, returns the result or -EAGAIN to keep waiting
+static int ev_req_perform(ev_req_t *req)
+{
+    ssize_t ret;
+
+    switch (req->op)
+    {
+    case EV_OP_READ:
+        ret = read(req->fd, req->buf, req->len);
+        break;
+    case EV_OP_WRITE:
+        ret = write(req->fd, req->buf, req->len);
+        break;
+    case EV_OP_ACCEPT:
+        ret = accept(req->fd, req->addr, req->addrlen);
+        break;
+    case EV_OP_CONNECT:
+        if (req->io.active)
+        {
+            // Became writable, the outcome of the connect is in SO_ERROR
+            int error = 0;
+            socklen_t error_len = sizeof(error);
+            if (getsockopt(req->fd, SOL_SOCKET, SO_ERROR, &error, &error_len) == -1)
+                return -errno;
+            return -error;
+        }
+        ret = connect(req->fd, req->addr, req->addr_size);
+        if (ret == -1 && errno == EINPROGRESS)
+            return -EAGAIN;
+        break;
+    case EV_OP_SENDMSG:
+        ret = sendmsg(req->fd, req->msg, req->flags);
+        break;
+    case EV_OP_READ_POOLED:
+        // Only now that we are about to read does a buffer leave the pool
+        req->buf = ev_buf_pool_take(req->pool);
+        if (!req->buf)
+            return -ENOBUFS;
+        ret = read(req->fd, req->buf, req->pool->buf_size);
+        if (ret <= 0)
+        {
+            ev_buf_pool_put(req->pool, req->buf);
+            req->buf = NULL;
+        }
+        break;
+    case EV_OP_SEND_ZC:
+        return ev_req_send_zc(req);
+    default:
+        return -EINVAL;
+    }
+
+    if (ret == -1)
+        return (errno == EWOULDBLOCK) ? -EAGAIN : -errno;
+    return (int)ret;
+}
+
+// Readiness the request is waiting for in its current step
+static int ev_req_events(ev_req_t *req)
+{
+    switch (req->op)
+    {
+    case EV_OP_READ:
+    case EV_OP_READ_POOLED:
+    case EV_OP_ACCEPT:
+        return EV_READ;
+    case EV_OP_SEND_ZC:
+        return req->zc_notify ? 0 : EV_WRITE;
+    default:
+        return EV_WRITE;
+    }
+}
+
+// (Re)arm the request's watcher for its current step
+static void ev_req_wait(ev_loop_t *loop, ev_req_t *req)
+{
+    // Moving on to the next step only changes what the watcher waits for
+    ev_io_modify(loop, &req->io, ev_req_events(req));
+    ev_io_start(loop, &req->io);
+}
+
+static void ev_req_io_cb(ev_io_t *watcher, int revents)
+{
+    (void)revents;
+    ev_req_t *req = (ev_req_t *)((char *)watcher - offsetof(ev_req_t, io));
+
+    int result = ev_req_perform(req);
+    if (result == -EAGAIN || result == -EINTR)
+    {
+        ev_req_wait(req->loop, req); // Not done yet, maybe on to the next step
+        return;
+    }
+
+    ev_io_stop(req->loop, &req->io);
+    req->active = false;
+    req->callback(req, result);
+}
+
+static void ev_req_emulate(ev_loop_t *loop, ev_req_queue_t *completed, ev_req_t *req)
+{
+    // Set the watcher up the first time the request runs on this fd, ev_io_set
+    // also switches the fd to non-blocking before the first attempt. Later
+    // submissions on the same fd reuse both and cost no fcntl.
+    if (req->io.callback != ev_req_io_cb || req->io.fd != req->fd)
+        ev_io_init(&req->io, ev_req_io_cb, req->fd, ev_req_events(req));
+    else
+        req->io.events = ev_req_events(req);
+
+    int result = ev_req_perform(req);
+    if (result == -EAGAIN || result == -EINTR)
+    {
+        ev_req_wait(loop, req);
+        return;
+    }
+
+    req->result = result;
+    ev_req_queue_push(completed, req);
+}
@@ -0,0 +1,343 @@
+#include "libekio.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#if HAVE_LINUX
+#include <sched.h>
+#endif
+
+// Most CPUs a runtime spreads its loops over
+#define EV_RUNTIME_MAX_CPUS 1024
+
+/*
+ * Thread-per-core runtime.
+ *
+ * A runtime runs one loop per thread and, on Linux, pins thread i to the
+ * i-th CPU the process may run on. Nothing is shared between the loops: each
+ * one creates its own backend, timers and buffers on its own (pinned) thread
+ * and, when the runtime listens, owns its own SO_REUSEPORT socket so the
+ * kernel spreads incoming connections across loops without a shared accept
+ * queue or lock.
+ *
+ * The only cross-thread traffic is ev_runtime_stop, which sends every loop
+ * its stop async watcher.
+ */
+
+typedef struct ev_runtime_worker
+{
+    ev_runtime_t *runtime;
+    int index;
+    int cpu;           // CPU the thread is pinned to, -1 if not pinned
+    ev_loop_t *loop;   // Runs on the worker thread, destroyed on join
+    pthread_t thread;
+    bool started;      // Thread was created and needs a join
+    int listen_fd;     // SO_REUSEPORT listener of this loop, -1 if none
+    ev_async_t stop_watcher;
+} ev_runtime_worker_t;
+
+struct ev_runtime
+{
+    ev_runtime_options_t options;
+    ev_runtime_worker_t *workers;
+    int count;
+    pthread_mutex_t lock; // Guards ready/failed while workers come up
+    pthread_cond_t cond;
+    int ready;            // Workers that finished setup
+    int failed;           // Workers that could not create their loop
+};
+
+// Open a non-blocking listening socket that shares its port with other SO_REUSEPORT sockets
+int ev_listen_reuseport(const struct sockaddr *addr, socklen_t addrlen, int backlog)
+{
+    int fd = socket(addr->sa_family, SOCK_STREAM, 0);
+    if (fd == -1)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    int on = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1)
+    {
+        perror("setsockopt SO_REUSEPORT");
+        close(fd);
+        return -1;
+    }
+
+    if (bind(fd, addr, addrlen) == -1 || listen(fd, backlog) == -1)
+    {
+        perror("Failed to listen");
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+void ev_runtime_options_init(ev_runtime_options_t *options)
+{
+    options->threads = 0;
+    options->pin = true;
+    options->listen_addr = NULL;
+    options->listen_addrlen = 0;
+    options->backlog = 1024;
+    ev_loop_options_init(&options->loop);
+    options->setup = NULL;
+    options->data = NULL;
+}
+
+// Fill `cpus` with the CPUs this process may run on, returns how many
+static int ev_runtime_cpus(int *cpus, int max)
+{
+    int count = 0;
+#if HAVE_LINUX
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE && count < max; cpu++)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+                cpus[count++] = cpu;
+        }
+        return count;
+    }
+#endif
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    for (long cpu = 0; cpu < online && count < max; cpu++)
+        cpus[count++] = (int)cpu;
+    return count > 0 ? count : 1;
+}
+
+static void ev_runtime_pin(ev_runtime_worker_t *worker)
+{
+#if HAVE_LINUX
+    if (worker->cpu < 0)
+        return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(worker->cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0)
+        fprintf(stderr, "Failed to pin loop %d to cpu %d: %d\n", worker->index, worker->cpu, err);
+#else
+    // No hard affinity on this platform, the scheduler places the threads
+    (void)worker;
+#endif
+}
+
+static void ev_runtime_stop_cb(ev_async_t *watcher, int revents)
+{
+    (void)revents;
+    ev_runtime_worker_t *worker = (ev_runtime_worker_t *)watcher->data;
+    ev_break(worker->loop, EVBREAK_ALL);
+}
+
+static void ev_runtime_report(ev_runtime_t *runtime, bool ok)
+{
+    pthread_mutex_lock(&runtime->lock);
+    if (ok)
+        runtime->ready++;
+    else
+        runtime->failed++;
+    pthread_cond_broadcast(&runtime->cond);
+    pthread_mutex_unlock(&runtime->lock);
+}
+
+static void *ev_runtime_thread(void *arg)
+{
+    ev_runtime_worker_t *worker = (ev_runtime_worker_t *)arg;
+    ev_runtime_t *runtime = worker->runtime;
+
+    // Pin before the loop allocates so its memory is local to the CPU
+    ev_runtime_pin(worker);
+
+    worker->loop = ev_loop_create_with_options(&runtime->options.loop);
+    if (!worker->loop)
+    {
+        ev_runtime_report(runtime, false);
+        return NULL;
+    }
+
+    ev_async_start(worker->loop, &worker->stop_watcher);
+
+    if (runtime->options.setup)
+        runtime->options.setup(worker->loop, worker->index, worker->listen_fd, runtime->options.data);
+
+    ev_runtime_report(runtime, true);
+
+    ev_run(worker->loop, 0);
+
+    // The loop itself is destroyed by ev_runtime_join, a late
+    // ev_runtime_stop may still send to it until then
+    ev_async_stop(worker->loop, &worker->stop_watcher);
+    return NULL;
+}
+
+ev_runtime_t *ev_runtime_create(const ev_runtime_options_t *options)
+{
+    ev_runtime_t *runtime = (ev_runtime_t *)calloc(1, sizeof(ev_runtime_t));
+    if (!runtime)
+        return NULL;
+
+    if (options)
+        runtime->options = *options;
+    else
+        ev_runtime_options_init(&runtime->options);
+
+    int cpus[EV_RUNTIME_MAX_CPUS];
+    int cpu_count = ev_runtime_cpus(cpus, EV_RUNTIME_MAX_CPUS);
+    runtime->count = runtime->options.threads > 0 ? runtime->options.threads : cpu_count;
+
+    runtime->workers = (ev_runtime_worker_t *)calloc(runtime->count, sizeof(ev_runtime_worker_t));
+    if (!runtime->workers)
+    {
+        free(runtime);
+        return NULL;
+    }
+
+    pthread_mutex_init(&runtime->lock, NULL);
+    pthread_cond_init(&runtime->cond, NULL);
+
+    for (int i = 0; i < runtime->count; i++)
+    {
+        ev_runtime_worker_t *worker = &runtime->workers[i];
+        worker->runtime = runtime;
+        worker->index = i;
+        worker->cpu = runtime->options.pin ? cpus[i % cpu_count] : -1;
+        worker->listen_fd = -1;
+        ev_async_init(&worker->stop_watcher, ev_runtime_stop_cb);
+        worker->stop_watcher.data = worker;
+    }
+
+    // Bind every listener up front so address errors surface here and the
+    // kernel's reuseport group is complete before the first connection
+    for (int i = 0; i < runtime->count; i++)
+    {
+        ev_runtime_worker_t *worker = &runtime->workers[i];
+        if (runtime->options.listen_addr)
+        {
+            worker->listen_fd = ev_listen_reuseport(runtime->options.listen_addr, runtime->options.listen_addrlen, runtime->options.backlog);
+            if (worker->listen_fd == -1)
+            {
+                ev_runtime_destroy(runtime);
+                return NULL;
+            }
+        }
+    }
+
+    return runtime;
+}
+
+// Spawn every loop thread, returns once all of them ran their setup
+int ev_runtime_start(ev_runtime_t *runtime)
+{
+    if (!runtime)
+        return -1;
+
+    int spawned = 0;
+    for (int i = 0; i < runtime->count; i++)
+    {
+        ev_runtime_worker_t *worker = &runtime->workers[i];
+        int err = pthread_create(&worker->thread, NULL, ev_runtime_thread, worker);
+        if (err != 0)
+        {
+            fprintf(stderr, "Failed to start loop thread %d: %d\n", i, err);
+            break;
+        }
+        worker->started = true;
+        spawned++;
+    }
+
+    pthread_mutex_lock(&runtime->lock);
+    while (runtime->ready + runtime->failed < spawned)
+        pthread_cond_wait(&runtime->cond, &runtime->lock);
+    int ok = spawned == runtime->count && runtime->failed == 0;
+    pthread_mutex_unlock(&runtime->lock);
+
+    if (!ok)
+    {
+        ev_runtime_stop(runtime);
+        ev_runtime_join(runtime);
+        return -1;
+    }
+    return 0;
+}
+
+// Ask every loop to break, safe to call from any thread or signal handler
+void ev_runtime_stop(ev_runtime_t *runtime)
+{
+    if (!runtime)
+        return;
+
+    for (int i = 0; i < runtime->count; i++)
+    {
+        ev_runtime_worker_t *worker = &runtime->workers[i];
+        if (worker->started && worker->loop)
+            ev_async_send(worker->loop, &worker->stop_watcher);
+    }
+}
+
+// Wait for every loop thread to return
+void ev_runtime_join(ev_runtime_t *runtime)
+{
+    if (!runtime)
+        return;
+
+    for (int i = 0; i < runtime->count; i++)
+    {
+        ev_runtime_worker_t *worker = &runtime->workers[i];
+        if (worker->started)
+        {
+            pthread_join(worker->thread, NULL);
+            worker->started = false;
+        }
+        if (worker->loop)
+        {
+            ev_loop_destroy(worker->loop);
+            worker->loop = NULL;
+        }
+    }
+}
+
+void ev_runtime_destroy(ev_runtime_t *runtime)
+{
+    if (!runtime)
+        return;
+
+    ev_runtime_stop(runtime);
+    ev_runtime_join(runtime);
+
+    for (int i = 0; i < runtime->count; i++)
+    {
+        ev_runtime_worker_t *worker = &runtime->workers[i];
+        if (worker->listen_fd != -1)
+            close(worker->listen_fd);
+    }
+
+    pthread_cond_destroy(&runtime->cond);
+    pthread_mutex_destroy(&runtime->lock);
+    free(runtime->workers);
+    free(runtime);
+}
+
+int ev_runtime_size(ev_runtime_t *runtime)
+{
+    return runtime ? runtime->count : 0;
+}
+
+// Loop `index` lives from ev_runtime_start until ev_runtime_join, only touch it from its own thread
+ev_loop_t *ev_runtime_loop(ev_runtime_t *runtime, int index)
+{
+    if (!runtime || index < 0 || index >= runtime->count)
+        return NULL;
+    return runtime->workers[index].loop;
+}
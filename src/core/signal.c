@@ -0,0 +1,204 @@
+#include "libekio.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#if HAVE_LINUX
+#include <sys/signalfd.h>
+#endif
+
+/*
+ * Signal watchers.
+ *
+ * Signals reach the loop as ordinary events, never through an asynchronous
+ * handler: on Linux the watched signals are blocked and read from one
+ * signalfd per loop, on kqueue they are caught by a handler that does
+ * nothing and reported by EVFILT_SIGNAL. The disposition they had before is
+ * put back once the last watcher stops. Every signal that arrived since the last poll is dispatched
+ * once, however often it was raised in between.
+ *
+ * A process-directed signal goes to whichever thread does not block it, and
+ * only one reader can dequeue it, so each signal number belongs to at most
+ * one loop at a time. Threads other than the loop's must keep watched
+ * signals blocked (thread pool workers block everything).
+ */
+
+#if HAVE_LINUX
+#define EV_HAVE_SIGNALFD 1
+#else
+#define EV_HAVE_SIGNALFD 0
+#endif
+
+typedef struct ev_signal_set
+{
+    ev_signal_t *heads[NSIG]; // Active watchers per signal number
+    int count;                // Active watchers in all lists
+    ev_io_t watcher;          // signalfd watcher, kqueue event udata
+    int fd;                   // signalfd, -1 until the first watcher starts
+    sigset_t mask;            // Signals routed to fd
+#if !EV_HAVE_SIGNALFD
+    struct sigaction previous[NSIG]; // Dispositions replaced while watched
+#endif
+} ev_signal_set_t;
+
+// Loop that currently owns each signal number
+static ev_loop_t *signal_owners[NSIG];
+
+static void ev_signal_set_init(ev_signal_set_t *set)
+{
+    for (int i = 0; i < NSIG; i++)
+        set->heads[i] = NULL;
+    set->count = 0;
+    set->fd = -1;
+    sigemptyset(&set->mask);
+}
+
+// Claim `signum` for `loop`, fails if another loop watches it
+static bool ev_signal_claim(ev_loop_t *loop, int signum)
+{
+    ev_loop_t *owner = NULL;
+    if (__atomic_compare_exchange_n(&signal_owners[signum], &owner, loop, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return true;
+    return owner == loop;
+}
+
+static void ev_signal_release(ev_loop_t *loop, int signum)
+{
+    ev_loop_t *owner = loop;
+    __atomic_compare_exchange_n(&signal_owners[signum], &owner, NULL, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+// Call every watcher of one signal, a callback may stop its own watcher
+static void ev_signal_set_dispatch(ev_signal_set_t *set, int signum)
+{
+    ev_signal_t *watcher = set->heads[signum];
+    while (watcher)
+    {
+        ev_signal_t *next = watcher->next;
+        if (watcher->active)
+            watcher->callback(watcher, 0);
+        watcher = next;
+    }
+}
+
+#if EV_HAVE_SIGNALFD
+// Route `signum` to the loop's signalfd, or stop doing so
+static int ev_signal_set_route(ev_signal_set_t *set, ev_backend_t *backend, int signum, bool enable)
+{
+    (void)backend;
+    sigset_t one;
+    sigemptyset(&one);
+    sigaddset(&one, signum);
+
+    if (enable)
+    {
+        sigaddset(&set->mask, signum);
+        // Blocked signals stay queued for the signalfd instead of being delivered
+        pthread_sigmask(SIG_BLOCK, &one, NULL);
+    }
+    else
+    {
+        sigdelset(&set->mask, signum);
+        pthread_sigmask(SIG_UNBLOCK, &one, NULL);
+    }
+
+    int fd = signalfd(set->fd, &set->mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd == -1)
+    {
+        perror("signalfd");
+        return -1;
+    }
+    set->fd = fd;
+    return 0;
+}
+
+// Read every queued signal, then dispatch each signal number once
+static void ev_signal_set_read(ev_signal_set_t *set)
+{
+    struct signalfd_siginfo info[16];
+    bool raised[NSIG] = {false};
+    ssize_t n;
+
+    while ((n = read(set->fd, info, sizeof(info))) > 0)
+    {
+        for (size_t i = 0; i < (size_t)n / sizeof(info[0]); i++)
+        {
+            if (info[i].ssi_signo < NSIG)
+                raised[info[i].ssi_signo] = true;
+        }
+    }
+
+    for (int signum = 1; signum < NSIG; signum++)
+    {
+        if (raised[signum])
+            ev_signal_set_dispatch(set, signum);
+    }
+}
+#else
+// Stands in for the default action while EVFILT_SIGNAL reports the signal.
+// SIG_IGN would do too, but an ignored SIGCHLD makes the kernel reap children
+// before anyone can wait for them.
+static void ev_signal_noop(int signum)
+{
+    (void)signum;
+}
+
+static int ev_signal_set_route(ev_signal_set_t *set, ev_backend_t *backend, int signum, bool enable)
+{
+    if (enable)
+    {
+        struct sigaction action = {0};
+        struct sigaction previous;
+        action.sa_handler = ev_signal_noop;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(signum, &action, &previous);
+
+        // Routed again after fork, the saved disposition is the user's already
+        if (previous.sa_handler != ev_signal_noop)
+            set->previous[signum] = previous;
+    }
+    else
+    {
+        sigaction(signum, &set->previous[signum], NULL);
+    }
+
+    int ret = ev_backend_signal(backend, signum, enable, &set->watcher);
+    if (ret != 0 && enable)
+        sigaction(signum, &set->previous[signum], NULL);
+    return ret;
+}
+#endif
+
+// Hand every watched signal to a new backend, the signalfd survives fork as is
+static int ev_signal_set_fork(ev_signal_set_t *set, ev_backend_t *backend)
+{
+#if !EV_HAVE_SIGNALFD
+    for (int signum = 1; signum < NSIG; signum++)
+    {
+        if (set->heads[signum] && ev_signal_set_route(set, backend, signum, true) != 0)
+            return -1;
+    }
+#else
+    (void)set;
+    (void)backend;
+#endif
+    return 0;
+}
+
+static void ev_signal_set_destroy(ev_signal_set_t *set, ev_loop_t *loop, ev_backend_t *backend)
+{
+    for (int signum = 1; signum < NSIG; signum++)
+    {
+        if (!set->heads[signum])
+            continue;
+        ev_signal_set_route(set, backend, signum, false);
+        ev_signal_release(loop, signum);
+    }
+
+    if (set->fd != -1)
+        close(set->fd);
+}
@@ -0,0 +1,181 @@
+#include "libekio.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+/*
+ * Object pools (slab allocator).
+ *
+ * A pool hands out objects of up to its size from power-of-two size classes,
+ * 64 bytes (one cache line) and up, so every object is cache-line aligned and
+ * never shares a line with another. Objects are carved from 64 KB slabs
+ * aligned to their own size; the first line of a slab is its header, so the
+ * class of any object is one mask away and ev_pool_free needs no size.
+ *
+ * A pool belongs to the thread that created it, a loop's pool to the thread
+ * running the loop, and only the owner allocates. There alloc and free are a
+ * pop and a push on the class's free list, without locks, and the most
+ * recently freed (cache-warm) object comes back first. Other threads may
+ * free too: their objects go on a lock-free list the owner takes back in one
+ * swap when a class runs dry. Slabs are kept until the pool is destroyed.
+ */
+
+#define EV_CACHE_LINE 64
+#define EV_SLAB_SIZE (64 * 1024)
+#define EV_POOL_CLASSES 9 // 64 bytes to 16 KB
+
+typedef struct ev_slab
+{
+    struct ev_slab *next; // Slabs of the pool, for destroy
+    ev_pool_t *pool;
+    int size_class;
+} ev_slab_t;
+
+typedef struct ev_pool_object
+{
+    struct ev_pool_object *next;
+} ev_pool_object_t;
+
+struct ev_pool
+{
+    ev_pool_object_t *free[EV_POOL_CLASSES]; // Free objects by class, owner thread only
+    ev_pool_object_t *remote;                // Freed by other threads, pushed atomically
+    ev_slab_t *slabs;
+    size_t size;     // Largest object
+    pthread_t owner; // Thread that may use the free lists directly
+};
+
+// Object size of a class
+static inline size_t ev_slab_class_size(int size_class)
+{
+    return (size_t)EV_CACHE_LINE << size_class;
+}
+
+// Smallest class that fits `size`
+static inline int ev_slab_class(size_t size)
+{
+    int size_class = 0;
+    while (ev_slab_class_size(size_class) < size)
+        size_class++;
+    return size_class;
+}
+
+static inline ev_slab_t *ev_slab_of(void *ptr)
+{
+    return (ev_slab_t *)((uintptr_t)ptr & ~(uintptr_t)(EV_SLAB_SIZE - 1));
+}
+
+static ev_pool_t *ev_slab_pool_create(size_t size)
+{
+    if (size == 0 || size > ev_slab_class_size(EV_POOL_CLASSES - 1))
+    {
+        fprintf(stderr, "Pool objects must be 1 to %zu bytes\n", ev_slab_class_size(EV_POOL_CLASSES - 1));
+        return NULL;
+    }
+
+    ev_pool_t *pool = (ev_pool_t *)calloc(1, sizeof(ev_pool_t));
+    if (!pool)
+    {
+        perror("Failed to allocate pool");
+        return NULL;
+    }
+    pool->size = size;
+    pool->owner = pthread_self();
+    return pool;
+}
+
+// Hand the pool to the calling thread, the previous owner must be done
+// allocating from it
+static void ev_slab_pool_bind(ev_pool_t *pool)
+{
+    __atomic_store_n(&pool->owner, pthread_self(), __ATOMIC_RELEASE);
+}
+
+static void ev_slab_pool_destroy(ev_pool_t *pool)
+{
+    ev_slab_t *slab = pool->slabs;
+    while (slab)
+    {
+        ev_slab_t *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    free(pool);
+}
+
+// Carve a new slab into free objects of one class
+static int ev_slab_grow(ev_pool_t *pool, int size_class)
+{
+    ev_slab_t *slab;
+    if (posix_memalign((void **)&slab, EV_SLAB_SIZE, EV_SLAB_SIZE) != 0)
+    {
+        perror("Failed to allocate pool slab");
+        return -1;
+    }
+    slab->pool = pool;
+    slab->size_class = size_class;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+
+    // Objects start after the header's cache line, the first one ends up on top
+    size_t size = ev_slab_class_size(size_class);
+    char *first = (char *)slab + EV_CACHE_LINE;
+    char *end = (char *)slab + EV_SLAB_SIZE;
+    for (char *object = end - (end - first) % size - size; object >= first; object -= size)
+    {
+        ((ev_pool_object_t *)object)->next = pool->free[size_class];
+        pool->free[size_class] = (ev_pool_object_t *)object;
+    }
+    return 0;
+}
+
+// Take back everything other threads freed
+static void ev_slab_drain_remote(ev_pool_t *pool)
+{
+    ev_pool_object_t *object = __atomic_exchange_n(&pool->remote, NULL, __ATOMIC_ACQUIRE);
+    while (object)
+    {
+        ev_pool_object_t *next = object->next;
+        int size_class = ev_slab_of(object)->size_class;
+        object->next = pool->free[size_class];
+        pool->free[size_class] = object;
+        object = next;
+    }
+}
+
+static void *ev_slab_alloc(ev_pool_t *pool, size_t size)
+{
+    if (size > pool->size)
+        return NULL;
+
+    int size_class = ev_slab_class(size ? size : 1);
+    if (!pool->free[size_class])
+    {
+        if (__atomic_load_n(&pool->remote, __ATOMIC_RELAXED))
+            ev_slab_drain_remote(pool);
+        if (!pool->free[size_class] && ev_slab_grow(pool, size_class) != 0)
+            return NULL;
+    }
+
+    ev_pool_object_t *object = pool->free[size_class];
+    pool->free[size_class] = object->next;
+    return object;
+}
+
+static void ev_slab_free(ev_pool_t *pool, void *ptr)
+{
+    ev_pool_object_t *object = (ev_pool_object_t *)ptr;
+
+    if (pthread_equal(pthread_self(), __atomic_load_n(&pool->owner, __ATOMIC_ACQUIRE)))
+    {
+        int size_class = ev_slab_of(ptr)->size_class;
+        object->next = pool->free[size_class];
+        pool->free[size_class] = object;
+        return;
+    }
+
+    object->next = __atomic_load_n(&pool->remote, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&pool->remote, &object->next, object, true, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED))
+        ;
+}
@@ -0,0 +1,93 @@
+#include "libekio.h"
+#include <time.h>
+
+/*
+ * Loop metrics behind ev_loop_stats.
+ *
+ * Only the loop's own thread writes them, one relaxed atomic store per field,
+ * so another thread can read any field without a lock and never sees it torn.
+ * A snapshot is not taken atomically as a whole: counters read a moment apart
+ * may disagree by an iteration.
+ *
+ * Histograms are log2-bucketed, recording a value is a count-leading-zeros and
+ * a handful of stores, cheap enough to run for every callback.
+ */
+
+// Monotonic time in seconds, the clock timer deadlines and metrics are measured on
+static double ev_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Seconds to whole microseconds, clock steps backwards count as 0
+static inline uint64_t ev_stats_us(double seconds)
+{
+    return seconds > 0 ? (uint64_t)(seconds * 1e6) : 0;
+}
+
+static inline void ev_stats_add(uint64_t *counter, uint64_t n)
+{
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+static inline void ev_stats_set(uint64_t *gauge, uint64_t value)
+{
+    __atomic_store_n(gauge, value, __ATOMIC_RELAXED);
+}
+
+// Bucket 0 holds 0, bucket i holds [2^(i-1), 2^i), the last one everything above
+static inline int ev_histogram_bucket(uint64_t value)
+{
+    if (value == 0)
+        return 0;
+    int bucket = 64 - __builtin_clzll(value);
+    return bucket < EV_STATS_BUCKETS ? bucket : EV_STATS_BUCKETS - 1;
+}
+
+static void ev_histogram_record(ev_histogram_t *histogram, uint64_t value)
+{
+    ev_stats_add(&histogram->count, 1);
+    ev_stats_add(&histogram->sum, value);
+    if (value > histogram->max)
+        ev_stats_set(&histogram->max, value);
+    ev_stats_add(&histogram->buckets[ev_histogram_bucket(value)], 1);
+}
+
+// Copy the metrics field by field, safe from any thread
+static void ev_stats_read(const ev_loop_stats_t *stats, ev_loop_stats_t *out)
+{
+    // Every field of ev_loop_stats_t is a uint64_t
+    const uint64_t *from = (const uint64_t *)stats;
+    uint64_t *to = (uint64_t *)out;
+
+    for (size_t i = 0; i < sizeof(ev_loop_stats_t) / sizeof(uint64_t); i++)
+        to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+}
+
+// Upper bound of the bucket holding the q-th quantile (0..1), 0 when empty
+uint64_t ev_histogram_percentile(const ev_histogram_t *histogram, double q)
+{
+    if (histogram->count == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(q * histogram->count);
+    if (rank >= histogram->count)
+        rank = histogram->count - 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < EV_STATS_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen > rank)
+        {
+            if (i == 0)
+                return 0;
+            // The top bucket is open ended, max is the best bound it has
+            uint64_t bound = i < EV_STATS_BUCKETS - 1 ? ((uint64_t)1 << i) - 1 : histogram->max;
+            return bound < histogram->max ? bound : histogram->max;
+        }
+    }
+    return histogram->max;
+}
@@ -0,0 +1,208 @@
+#include "libekio.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+
+/*
+ * Blocking-work thread pool.
+ *
+ * One pool serves every loop in the process and is started on first use.
+ * Each worker owns a FIFO queue. A loop always submits to the same queue
+ * (picked round-robin when the loop first submits), so one loop's work tends
+ * to stay on one worker and its cache. A worker whose own queue is empty
+ * steals from the others before it goes to sleep, so a burst from one loop
+ * still spreads over the whole pool.
+ *
+ * Workers never touch a loop. A finished item is posted back to its loop
+ * as an ev_task_t and its done callback runs there, in the loop's thread.
+ */
+
+#define EV_WORK_DEFAULT_THREADS 4
+#define EV_WORK_MAX_THREADS 256
+
+typedef struct ev_work_queue
+{
+    pthread_mutex_t lock;
+    ev_work_t *head;
+    ev_work_t *tail;
+} ev_work_queue_t;
+
+typedef struct ev_thread_pool
+{
+    ev_work_queue_t *queues; // One per worker
+    int count;               // Number of workers
+    unsigned next_queue;     // Round-robin queue assignment for loops
+    int queued;              // Items waiting in any queue
+    int idle;                // Workers asleep on idle_cond
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+} ev_thread_pool_t;
+
+static ev_thread_pool_t *thread_pool = NULL;
+static int thread_pool_size = 0; // Requested by ev_work_pool_init, 0 for the default
+static int thread_pool_started = 0; // Workers actually running
+static pthread_once_t thread_pool_once = PTHREAD_ONCE_INIT;
+
+static void ev_work_queue_push(ev_work_queue_t *queue, ev_work_t *work)
+{
+    work->next = NULL;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail)
+        queue->tail->next = work;
+    else
+        __atomic_store_n(&queue->head, work, __ATOMIC_RELAXED);
+    queue->tail = work;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static ev_work_t *ev_work_queue_pop(ev_work_queue_t *queue)
+{
+    // Racy peek, skips the lock on the empty queues a thief walks past
+    if (!__atomic_load_n(&queue->head, __ATOMIC_RELAXED))
+        return NULL;
+
+    pthread_mutex_lock(&queue->lock);
+    ev_work_t *work = queue->head;
+    if (work)
+    {
+        __atomic_store_n(&queue->head, work->next, __ATOMIC_RELAXED);
+        if (!queue->head)
+            queue->tail = NULL;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return work;
+}
+
+// Own queue first, then steal from the others
+static ev_work_t *ev_thread_pool_take(ev_thread_pool_t *pool, int self)
+{
+    for (int i = 0; i < pool->count; i++)
+    {
+        ev_work_t *work = ev_work_queue_pop(&pool->queues[(self + i) % pool->count]);
+        if (work)
+        {
+            __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+            return work;
+        }
+    }
+    return NULL;
+}
+
+static void *ev_thread_pool_worker(void *arg)
+{
+    ev_thread_pool_t *pool = thread_pool;
+    int self = (int)(intptr_t)arg;
+
+    for (;;)
+    {
+        ev_work_t *work = ev_thread_pool_take(pool, self);
+        if (!work)
+        {
+            // Announce ourselves idle before the last look at `queued`,
+            // the submitter does it the other way round (see push)
+            pthread_mutex_lock(&pool->idle_lock);
+            __atomic_add_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) == 0)
+                pthread_cond_wait(&pool->idle_cond, &pool->idle_lock);
+            __atomic_sub_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&pool->idle_lock);
+            continue;
+        }
+
+        // Shed work that sat in the queue past its loop's latency budget
+        if (work->deadline > 0 && ev_time() > work->deadline)
+        {
+            work->status = -ETIMEDOUT;
+        }
+        else
+        {
+            work->work(work);
+            work->status = 0;
+        }
+
+        ev_loop_post(work->loop, &work->task);
+    }
+    return NULL;
+}
+
+static void ev_thread_pool_start(void)
+{
+    ev_thread_pool_t *pool = (ev_thread_pool_t *)calloc(1, sizeof(ev_thread_pool_t));
+    if (!pool)
+    {
+        perror("Failed to allocate thread pool");
+        return;
+    }
+
+    int threads = thread_pool_size > 0 ? thread_pool_size : EV_WORK_DEFAULT_THREADS;
+    pool->queues = (ev_work_queue_t *)calloc(threads, sizeof(ev_work_queue_t));
+    if (!pool->queues)
+    {
+        perror("Failed to allocate thread pool queues");
+        free(pool);
+        return;
+    }
+
+    for (int i = 0; i < threads; i++)
+        pthread_mutex_init(&pool->queues[i].lock, NULL);
+    pthread_mutex_init(&pool->idle_lock, NULL);
+    pthread_cond_init(&pool->idle_cond, NULL);
+
+    // Every queue gets drained by stealing even if its own worker failed to start
+    pool->count = threads;
+    __atomic_store_n(&thread_pool, pool, __ATOMIC_RELEASE);
+
+    // Workers inherit a fully blocked mask so signals go to the loop threads
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, ev_thread_pool_worker, (void *)(intptr_t)i) != 0)
+        {
+            perror("Failed to start thread pool worker");
+            break;
+        }
+        pthread_detach(thread);
+        thread_pool_started++;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+}
+
+static ev_thread_pool_t *ev_thread_pool_get(void)
+{
+    pthread_once(&thread_pool_once, ev_thread_pool_start);
+    return thread_pool_started > 0 ? thread_pool : NULL;
+}
+
+static void ev_thread_pool_push(ev_thread_pool_t *pool, int queue, ev_work_t *work)
+{
+    ev_work_queue_push(&pool->queues[queue % pool->count], work);
+    __atomic_add_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+
+    // A worker marks itself idle before it checks `queued` and sleeps, so
+    // either it sees this item or we see it idle and wake it
+    if (__atomic_load_n(&pool->idle, __ATOMIC_SEQ_CST) > 0)
+    {
+        pthread_mutex_lock(&pool->idle_lock);
+        pthread_cond_signal(&pool->idle_cond);
+        pthread_mutex_unlock(&pool->idle_lock);
+    }
+}
+
+// Size the pool before its first use, returns -1 once it is running
+int ev_work_pool_init(int threads)
+{
+    if (threads <= 0 || threads > EV_WORK_MAX_THREADS)
+        return -1;
+    if (__atomic_load_n(&thread_pool, __ATOMIC_ACQUIRE))
+        return -1;
+
+    thread_pool_size = threads;
+    return 0;
+}
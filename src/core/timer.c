@@ -0,0 +1,237 @@
+#include "libekio.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+
+/*
+ * Loop-owned timer heap.
+ *
+ * Active timers live in a 4-ary min-heap ordered by their absolute expiry
+ * time (`ev_timer_t.at`). Every timer remembers its slot in `heap_index` so
+ * stop and re-arm are O(log n) without a search, and none of them touch the
+ * kernel: the loop just turns the top of the heap into a poll timeout.
+ *
+ * Pushing a deadline later (ev_timer_again on an idle timeout) only updates
+ * `ev_timer_t.expires`. The heap keeps the stale, earlier key and the timer is
+ * moved to its real slot when that stale key reaches the top and is found to
+ * be early, so a timer reset on every read costs O(1).
+ */
+
+#define EV_TIMER_HEAP_ARITY 4
+#define EV_TIMER_HEAP_PARENT(i) (((i) - 1) / EV_TIMER_HEAP_ARITY)
+#define EV_TIMER_HEAP_CHILD(i) ((i) * EV_TIMER_HEAP_ARITY + 1)
+#define EV_TIMER_HEAP_MIN_CAPACITY 64
+
+typedef struct ev_timer_heap
+{
+    ev_timer_t **nodes; // Heap array, nodes[0] expires first
+    int count;          // Number of active timers
+    int capacity;       // Allocated slots in nodes
+} ev_timer_heap_t;
+
+static int ev_timer_heap_init(ev_timer_heap_t *heap)
+{
+    heap->count = 0;
+    heap->capacity = EV_TIMER_HEAP_MIN_CAPACITY;
+    heap->nodes = (ev_timer_t **)malloc(sizeof(ev_timer_t *) * heap->capacity);
+    if (!heap->nodes)
+    {
+        perror("Failed to allocate timer heap");
+        return -1;
+    }
+    return 0;
+}
+
+static void ev_timer_heap_destroy(ev_timer_heap_t *heap)
+{
+    free(heap->nodes);
+    heap->nodes = NULL;
+    heap->count = 0;
+    heap->capacity = 0;
+}
+
+static inline void ev_timer_heap_place(ev_timer_heap_t *heap, int index, ev_timer_t *timer)
+{
+    heap->nodes[index] = timer;
+    timer->heap_index = index;
+}
+
+// Move a node towards the root until its parent expires no later than it
+static void ev_timer_heap_up(ev_timer_heap_t *heap, int index)
+{
+    ev_timer_t *timer = heap->nodes[index];
+
+    while (index > 0)
+    {
+        int parent = EV_TIMER_HEAP_PARENT(index);
+        if (heap->nodes[parent]->at <= timer->at)
+            break;
+
+        ev_timer_heap_place(heap, index, heap->nodes[parent]);
+        index = parent;
+    }
+
+    ev_timer_heap_place(heap, index, timer);
+}
+
+// Move a node towards the leaves until all of its children expire after it
+static void ev_timer_heap_down(ev_timer_heap_t *heap, int index)
+{
+    ev_timer_t *timer = heap->nodes[index];
+
+    for (;;)
+    {
+        int first = EV_TIMER_HEAP_CHILD(index);
+        if (first >= heap->count)
+            break;
+
+        int last = first + EV_TIMER_HEAP_ARITY;
+        if (last > heap->count)
+            last = heap->count;
+
+        int min = first;
+        for (int child = first + 1; child < last; child++)
+        {
+            if (heap->nodes[child]->at < heap->nodes[min]->at)
+                min = child;
+        }
+
+        if (heap->nodes[min]->at >= timer->at)
+            break;
+
+        ev_timer_heap_place(heap, index, heap->nodes[min]);
+        index = min;
+    }
+
+    ev_timer_heap_place(heap, index, timer);
+}
+
+// Restore heap order after `timer->at` changed in place
+static void ev_timer_heap_adjust(ev_timer_heap_t *heap, ev_timer_t *timer)
+{
+    int index = timer->heap_index;
+
+    if (index > 0 && heap->nodes[EV_TIMER_HEAP_PARENT(index)]->at > timer->at)
+        ev_timer_heap_up(heap, index);
+    else
+        ev_timer_heap_down(heap, index);
+}
+
+static int ev_timer_heap_push(ev_timer_heap_t *heap, ev_timer_t *timer)
+{
+    if (heap->count == heap->capacity)
+    {
+        int capacity = heap->capacity * 2;
+        ev_timer_t **nodes = (ev_timer_t **)realloc(heap->nodes, sizeof(ev_timer_t *) * capacity);
+        if (!nodes)
+        {
+            perror("Failed to grow timer heap");
+            return -1;
+        }
+        heap->nodes = nodes;
+        heap->capacity = capacity;
+    }
+
+    ev_timer_heap_place(heap, heap->count++, timer);
+    ev_timer_heap_up(heap, timer->heap_index);
+    return 0;
+}
+
+static void ev_timer_heap_remove(ev_timer_heap_t *heap, ev_timer_t *timer)
+{
+    int index = timer->heap_index;
+    ev_timer_t *last = heap->nodes[--heap->count];
+
+    timer->heap_index = -1;
+    if (last == timer)
+        return;
+
+    ev_timer_heap_place(heap, index, last);
+    ev_timer_heap_adjust(heap, last);
+}
+
+static inline ev_timer_t *ev_timer_heap_top(ev_timer_heap_t *heap)
+{
+    return heap->count > 0 ? heap->nodes[0] : NULL;
+}
+
+// Move an active timer's deadline, reordering only if it moved earlier
+static void ev_timer_heap_rearm(ev_timer_heap_t *heap, ev_timer_t *timer, double expires)
+{
+    timer->expires = expires;
+    if (expires < timer->at)
+    {
+        timer->at = expires;
+        ev_timer_heap_up(heap, timer->heap_index);
+    }
+}
+
+// Clamp a poll timeout (ms, -1 = infinite) so the poll returns by the next deadline
+static int ev_timer_heap_timeout(ev_timer_heap_t *heap, double now, int timeout)
+{
+    ev_timer_t *next = ev_timer_heap_top(heap);
+    if (!next || timeout == 0)
+        return timeout;
+
+    double wait = (next->at - now) * 1e3;
+    if (wait <= 0)
+        return 0;
+
+    // Round up so we never wake just before the deadline and spin
+    int wait_ms = (wait >= INT_MAX - 1) ? INT_MAX : (int)wait + 1;
+    if (timeout < 0 || wait_ms < timeout)
+        return wait_ms;
+    return timeout;
+}
+
+// Invoke every timer whose deadline is before `now`, returns how many fired.
+// A timer started from a callback is due at `now` at the earliest, so it
+// waits for the next iteration even with a zero timeout. Each callback is
+// wrapped in `probe`, which also records lateness.
+static int ev_timer_heap_run(ev_timer_heap_t *heap, double now, ev_probe_t *probe)
+{
+    ev_timer_t *timer;
+    int fired = 0;
+
+    while ((timer = ev_timer_heap_top(heap)) && timer->at < now)
+    {
+        // Stale key left behind by a lazy re-arm, sink it to its real deadline
+        if (timer->expires >= now)
+        {
+            timer->at = timer->expires;
+            ev_timer_heap_down(heap, 0);
+            continue;
+        }
+
+        double deadline = timer->expires;
+        if (timer->repeat > 0)
+        {
+            // Keep the cadence, but don't replay a backlog of missed periods
+            timer->expires += timer->repeat;
+            if (timer->expires <= now)
+                timer->expires = now + timer->repeat;
+            timer->at = timer->expires;
+            ev_timer_heap_down(heap, 0);
+        }
+        else
+        {
+            ev_timer_heap_remove(heap, timer);
+            timer->active = 0;
+        }
+
+        if (ev_probe_active(probe))
+        {
+            if (probe->stats)
+                ev_histogram_record(&probe->stats->timer_lateness, ev_stats_us(now - deadline));
+            double start = ev_probe_enter(probe, TIMER_EVENT, -1, timer, (const void *)timer->callback);
+            timer->callback(timer, 0);
+            ev_probe_leave(probe, start);
+        }
+        else
+        {
+            timer->callback(timer, 0);
+        }
+        fired++;
+    }
+    return fired;
+}
@@ -0,0 +1,228 @@
+#include "libekio.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+
+/*
+ * Slow-callback watchdog.
+ *
+ * While the watchdog is on, the loop publishes a heartbeat around every I/O
+ * and timer callback: what is being called and since when. A thread of the
+ * watchdog's own wakes a few times per threshold, and when the same call is
+ * still running past the threshold it hands a report to the user's hook, once
+ * per call. The loop never waits for the watchdog, publishing is a handful of
+ * relaxed stores and one clock read.
+ *
+ * The heartbeat is a sequence lock. `seq` is odd while the loop rewrites the
+ * fields; the watchdog trusts what it read only if `seq` was even and didn't
+ * change meanwhile.
+ */
+
+typedef struct ev_heartbeat
+{
+    unsigned long seq;              // Odd while the fields below are rewritten
+    bool running;                   // A callback is running now
+    double start;                   // ev_time() when it was called
+    int type;                       // *_EVENT of its watcher
+    int fd;                         // -1 for watchers without one
+    const void *watcher;
+    const void *callback;
+    unsigned int iteration;
+    const unsigned int *loop_iteration; // The loop's counter, read on the loop thread only
+} ev_heartbeat_t;
+
+typedef struct ev_watchdog
+{
+    ev_heartbeat_t heartbeat;
+    struct ev_loop *loop;
+    double threshold; // Seconds
+    ev_watchdog_cb hook;
+    void *data;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool stopping;
+} ev_watchdog_t;
+
+// What the loop does around each I/O and timer callback, NULL members are off
+typedef struct ev_probe
+{
+    ev_loop_stats_t *stats;
+    ev_heartbeat_t *heartbeat;
+} ev_probe_t;
+
+static inline bool ev_probe_active(const ev_probe_t *probe)
+{
+    return probe->stats || probe->heartbeat;
+}
+
+// A callback is about to be called, returns its start time for ev_probe_leave
+static double ev_probe_enter(ev_probe_t *probe, int type, int fd, const void *watcher, const void *callback)
+{
+    double start = ev_time();
+    ev_heartbeat_t *heartbeat = probe->heartbeat;
+    if (!heartbeat)
+        return start;
+
+    unsigned long seq = heartbeat->seq;
+    __atomic_store_n(&heartbeat->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store(&heartbeat->start, &start, __ATOMIC_RELAXED);
+    __atomic_store_n(&heartbeat->type, type, __ATOMIC_RELAXED);
+    __atomic_store_n(&heartbeat->fd, fd, __ATOMIC_RELAXED);
+    __atomic_store_n(&heartbeat->watcher, watcher, __ATOMIC_RELAXED);
+    __atomic_store_n(&heartbeat->callback, callback, __ATOMIC_RELAXED);
+    __atomic_store_n(&heartbeat->iteration, *heartbeat->loop_iteration, __ATOMIC_RELAXED);
+    __atomic_store_n(&heartbeat->running, true, __ATOMIC_RELAXED);
+    __atomic_store_n(&heartbeat->seq, seq + 2, __ATOMIC_RELEASE);
+    return start;
+}
+
+// The callback returned
+static void ev_probe_leave(ev_probe_t *probe, double start)
+{
+    if (probe->heartbeat)
+        __atomic_store_n(&probe->heartbeat->running, false, __ATOMIC_RELEASE);
+    if (probe->stats)
+        ev_histogram_record(&probe->stats->callback, ev_stats_us(ev_time() - start));
+}
+
+// Read the heartbeat from the watchdog thread, false if it was being rewritten
+static bool ev_heartbeat_read(ev_heartbeat_t *heartbeat, ev_heartbeat_t *out)
+{
+    unsigned long seq = __atomic_load_n(&heartbeat->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+        return false;
+
+    out->seq = seq;
+    __atomic_load(&heartbeat->start, &out->start, __ATOMIC_RELAXED);
+    out->type = __atomic_load_n(&heartbeat->type, __ATOMIC_RELAXED);
+    out->fd = __atomic_load_n(&heartbeat->fd, __ATOMIC_RELAXED);
+    out->watcher = __atomic_load_n(&heartbeat->watcher, __ATOMIC_RELAXED);
+    out->callback = __atomic_load_n(&heartbeat->callback, __ATOMIC_RELAXED);
+    out->iteration = __atomic_load_n(&heartbeat->iteration, __ATOMIC_RELAXED);
+    out->running = __atomic_load_n(&heartbeat->running, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&heartbeat->seq, __ATOMIC_RELAXED) == seq;
+}
+
+static void *ev_watchdog_thread(void *arg)
+{
+    ev_watchdog_t *watchdog = (ev_watchdog_t *)arg;
+    unsigned long reported = 0; // seq of the last call reported, seqs start at 2
+
+    // A few looks per threshold, so a call is caught at most a quarter late
+    double tick = watchdog->threshold / 4;
+    if (tick < 1e-3)
+        tick = 1e-3;
+
+    pthread_mutex_lock(&watchdog->lock);
+    while (!watchdog->stopping)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        long nsec = deadline.tv_nsec + (long)(tick * 1e9);
+        deadline.tv_sec += nsec / 1000000000L;
+        deadline.tv_nsec = nsec % 1000000000L;
+        pthread_cond_timedwait(&watchdog->cond, &watchdog->lock, &deadline);
+        if (watchdog->stopping)
+            break;
+        pthread_mutex_unlock(&watchdog->lock);
+
+        ev_heartbeat_t beat;
+        double elapsed;
+        if (ev_heartbeat_read(&watchdog->heartbeat, &beat) && beat.running && beat.seq != reported &&
+            (elapsed = ev_time() - beat.start) > watchdog->threshold)
+        {
+            reported = beat.seq;
+
+            ev_slow_callback_t report;
+            report.loop = watchdog->loop;
+            report.type = beat.type;
+            report.fd = beat.fd;
+            report.watcher = beat.watcher;
+            report.callback = beat.callback;
+            report.iteration = beat.iteration;
+            report.elapsed = elapsed;
+            watchdog->hook(&report, watchdog->data);
+        }
+
+        pthread_mutex_lock(&watchdog->lock);
+    }
+    pthread_mutex_unlock(&watchdog->lock);
+    return NULL;
+}
+
+// Start the watchdog thread, also used again in a forked child
+static int ev_watchdog_start(ev_watchdog_t *watchdog)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&watchdog->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&watchdog->lock, NULL);
+    watchdog->stopping = false;
+
+    // The thread inherits a fully blocked mask so signals go to the loop threads
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    int err = pthread_create(&watchdog->thread, NULL, ev_watchdog_thread, watchdog);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+    if (err != 0)
+    {
+        fprintf(stderr, "Failed to start watchdog thread: %d\n", err);
+        pthread_cond_destroy(&watchdog->cond);
+        pthread_mutex_destroy(&watchdog->lock);
+        return -1;
+    }
+    return 0;
+}
+
+static void ev_watchdog_stop(ev_watchdog_t *watchdog)
+{
+    pthread_mutex_lock(&watchdog->lock);
+    watchdog->stopping = true;
+    pthread_cond_signal(&watchdog->cond);
+    pthread_mutex_unlock(&watchdog->lock);
+
+    pthread_join(watchdog->thread, NULL);
+    pthread_cond_destroy(&watchdog->cond);
+    pthread_mutex_destroy(&watchdog->lock);
+}
+
+static ev_watchdog_t *ev_watchdog_create(struct ev_loop *loop, const unsigned int *iteration, int threshold_ms,
+                                         ev_watchdog_cb hook, void *data)
+{
+    ev_watchdog_t *watchdog = (ev_watchdog_t *)calloc(1, sizeof(ev_watchdog_t));
+    if (!watchdog)
+    {
+        perror("Failed to allocate watchdog");
+        return NULL;
+    }
+
+    watchdog->heartbeat.loop_iteration = iteration;
+    watchdog->loop = loop;
+    watchdog->threshold = threshold_ms * 1e-3;
+    watchdog->hook = hook;
+    watchdog->data = data;
+
+    if (ev_watchdog_start(watchdog) != 0)
+    {
+        free(watchdog);
+        return NULL;
+    }
+    return watchdog;
+}
+
+static void ev_watchdog_destroy(ev_watchdog_t *watchdog)
+{
+    if (!watchdog)
+        return;
+    ev_watchdog_stop(watchdog);
+    free(watchdog);
+}
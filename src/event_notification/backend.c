@@ -0,0 +1,127 @@
+#include "libekio.h"
+#include <errno.h>
+
+/*
+ * Backends are picked per loop at runtime. Every backend file implements the
+ * operations below under its own prefix and exports them as one
+ * ev_backend_ops_t; its state struct starts with an ev_backend_t so the loop
+ * can hold any of them through the same pointer. The ev_backend_* functions
+ * are thin dispatchers through that table.
+ */
+
+typedef struct ev_backend_ops
+{
+    const char *name;
+    int kind; // EV_BACKEND_*
+    ev_backend_t *(*init)(const ev_loop_options_t *options);
+    void (*destroy)(ev_backend_t *backend);
+    void (*prepare)(ev_backend_t *backend);
+    int (*poll)(ev_backend_t *backend, int timeout);
+    void (*dispatch)(ev_backend_t *backend, int ready, ev_pending_queue_t *pending);
+    int (*is_empty)(ev_backend_t *backend);
+    int (*active_count)(ev_backend_t *backend);
+    void (*register_io)(ev_backend_t *backend, ev_io_t *watcher);
+    void (*unregister_io)(ev_backend_t *backend, ev_io_t *watcher);
+    void (*modify_io)(ev_backend_t *backend, ev_io_t *watcher, int events);
+    int (*submit)(ev_backend_t *backend, ev_req_t *req);
+    int (*buf_pool_register)(ev_backend_t *backend, ev_buf_pool_t *pool);
+    void (*buf_pool_unregister)(ev_backend_t *backend, ev_buf_pool_t *pool);
+    void (*buf_pool_recycle)(ev_backend_t *backend, ev_buf_pool_t *pool, unsigned id);
+    int (*notify)(ev_backend_t *backend, ev_backend_t *target, ev_io_t *watcher);
+    int (*signal)(ev_backend_t *backend, int signum, bool enable, ev_io_t *watcher);
+} ev_backend_ops_t;
+
+// Common head of every backend's state
+struct ev_backend
+{
+    const ev_backend_ops_t *ops; // Set by ev_backend_init
+};
+
+void ev_backend_destroy(ev_backend_t *backend)
+{
+    if (backend)
+        backend->ops->destroy(backend);
+}
+
+void ev_backend_prepare(ev_backend_t *backend)
+{
+    backend->ops->prepare(backend);
+}
+
+int ev_backend_poll(ev_backend_t *backend, int timeout)
+{
+    return backend->ops->poll(backend, timeout);
+}
+
+void ev_backend_dispatch(ev_backend_t *backend, int ready, ev_pending_queue_t *pending)
+{
+    backend->ops->dispatch(backend, ready, pending);
+}
+
+int ev_backend_is_empty(ev_backend_t *backend)
+{
+    return backend->ops->is_empty(backend);
+}
+
+int ev_backend_active_count(ev_backend_t *backend)
+{
+    return backend->ops->active_count(backend);
+}
+
+void ev_backend_register_io(ev_backend_t *backend, ev_io_t *watcher)
+{
+    backend->ops->register_io(backend, watcher);
+}
+
+void ev_backend_unregister_io(ev_backend_t *backend, ev_io_t *watcher)
+{
+    backend->ops->unregister_io(backend, watcher);
+}
+
+void ev_backend_modify_io(ev_backend_t *backend, ev_io_t *watcher, int events)
+{
+    backend->ops->modify_io(backend, watcher, events);
+}
+
+int ev_backend_submit(ev_backend_t *backend, ev_req_t *req)
+{
+    return backend->ops->submit(backend, req);
+}
+
+int ev_backend_buf_pool_register(ev_backend_t *backend, ev_buf_pool_t *pool)
+{
+    return backend->ops->buf_pool_register(backend, pool);
+}
+
+void ev_backend_buf_pool_unregister(ev_backend_t *backend, ev_buf_pool_t *pool)
+{
+    backend->ops->buf_pool_unregister(backend, pool);
+}
+
+void ev_backend_buf_pool_recycle(ev_backend_t *backend, ev_buf_pool_t *pool, unsigned id)
+{
+    backend->ops->buf_pool_recycle(backend, pool, id);
+}
+
+int ev_backend_notify(ev_backend_t *backend, ev_backend_t *target, ev_io_t *watcher)
+{
+    // Only a backend of the same kind knows how to reach the target directly
+    if (backend->ops != target->ops)
+        return -ENOSYS;
+    return backend->ops->notify(backend, target, watcher);
+}
+
+int ev_backend_signal(ev_backend_t *backend, int signum, bool enable, ev_io_t *watcher)
+{
+    return backend->ops->signal(backend, signum, enable, watcher);
+}
+
+int ev_backend_kind(ev_backend_t *backend)
+{
+    return backend->ops->kind;
+}
+
+const char *ev_backend_name(ev_backend_t *backend)
+{
+    return backend->ops->name;
+}
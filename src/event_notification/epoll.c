@@ -1,25 +1,53 @@
 #include "libekio.h"
 #include <sys/epoll.h>
-#include <sys/timerfd.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
 
+/*
+ * Interest changes are not sent to the kernel right away. Start, stop and
+ * modify only update the per-fd table and queue the fd on the changelist;
+ * right before polling each queued fd is compared with what the kernel
+ * already has and gets at most one epoll_ctl (or none if nothing changed).
+ * Events carry the fd rather than a watcher pointer, so a watcher freed after
+ * being stopped is never reached through a stale event.
+ */
+
+// Per-fd kernel registration state, indexed by fd
+typedef struct ev_epoll_fd
+{
+    ev_io_t *watcher; // Watcher of the fd, NULL when none
+    uint32_t kernel;  // Event mask last handed to the kernel (0 once a one-shot fired)
+    bool registered;  // fd is in the epoll set
+    bool changed;     // fd is queued on the changelist
+} ev_epoll_fd_t;
+
 // Backend-specific structure
-struct ev_backend
+typedef struct ev_epoll
 {
+    ev_backend_t base; // Must stay first, the loop only sees this part
     int epoll_fd;
     struct epoll_event *events;
     int max_events;
+    int min_events;  // Size the events array shrinks back to
+    int cap_events;  // Size the events array may grow to
+    int quiet_polls; // Consecutive polls that used under a quarter of the array
     int active_watcher_count;
-};
+    int ready_events; // Events returned by the last poll still being dispatched
+    int ready_index;  // Slot currently being dispatched
+    ev_epoll_fd_t *fds;  // Registration state by fd
+    int fd_capacity;     // Entries allocated in fds
+    int *changes;        // fds whose interest changed since the last poll
+    int change_count;    // Entries used in changes
+    int change_capacity; // Entries allocated in changes
+} ev_epoll_t;
 
 // Initialize backend
-ev_backend_t *ev_backend_init()
+static ev_backend_t *ev_epoll_init(const ev_loop_options_t *options)
 {
-    ev_backend_t *backend = (ev_backend_t *)malloc(sizeof(ev_backend_t));
+    ev_epoll_t *backend = (ev_epoll_t *)malloc(sizeof(ev_epoll_t));
     if (!backend)
         return NULL;
 
@@ -31,9 +59,19 @@ ev_backend_t *ev_backend_init()
         return NULL;
     }
 
-    backend->max_events = 64; // Default event size
+    backend->max_events = options->max_events;
+    backend->min_events = options->max_events;
+    backend->cap_events = options->max_events_cap;
+    backend->quiet_polls = 0;
     backend->events = (struct epoll_event *)malloc(sizeof(struct epoll_event) * backend->max_events);
     backend->active_watcher_count = 0;
+    backend->ready_events = 0;
+    backend->ready_index = 0;
+    backend->fds = NULL;
+    backend->fd_capacity = 0;
+    backend->changes = NULL;
+    backend->change_count = 0;
+    backend->change_capacity = 0;
     if (!backend->events)
     {
         perror("Failed to allocate events array");
@@ -42,74 +80,225 @@ ev_backend_t *ev_backend_init()
         return NULL;
     }
 
-    return backend;
+    return &backend->base;
 }
 
 // Destroy backend
-void ev_backend_destroy(ev_backend_t *backend)
+static void ev_epoll_destroy(ev_backend_t *base)
 {
+    ev_epoll_t *backend = (ev_epoll_t *)base;
     if (!backend)
         return;
 
     close(backend->epoll_fd);
     free(backend->events);
+    free(backend->fds);
+    free(backend->changes);
     free(backend);
 }
 
 // Prepare backend (queue pending tasks, etc.)
-void ev_backend_prepare(ev_backend_t *backend)
+static void ev_epoll_prepare(ev_backend_t *base)
 {
+    (void)base;
     // Prepare logic if necessary (e.g., fork watchers)
 }
 
-// Poll backend for events
-int ev_backend_poll(ev_backend_t *backend, int flags)
+// Grow the events array when a poll filled it, shrink it back after a quiet stretch.
+// Only called between poll and dispatch with `ready` events in the array, which
+// realloc preserves in both directions.
+static void ev_epoll_tune_events(ev_epoll_t *backend, int ready)
 {
-    int timeout = (!(flags & EVRUN_NOWAIT)) ? 0 : 1000; // Default 1-second timeout
-    return epoll_wait(backend->epoll_fd, backend->events, backend->max_events, timeout);
+    int size = backend->max_events;
+
+    if (ready == backend->max_events && backend->max_events < backend->cap_events)
+    {
+        size = backend->max_events * 2;
+        if (size > backend->cap_events)
+            size = backend->cap_events;
+        backend->quiet_polls = 0;
+    }
+    else if (ready < backend->max_events / 4 && backend->max_events > backend->min_events)
+    {
+        if (++backend->quiet_polls < EV_EVENTS_SHRINK_POLLS)
+            return;
+
+        size = backend->max_events / 2;
+        if (size < backend->min_events)
+            size = backend->min_events;
+        backend->quiet_polls = 0;
+    }
+    else
+    {
+        backend->quiet_polls = 0;
+        return;
+    }
+
+    if (size == backend->max_events)
+        return;
+
+    struct epoll_event *events = (struct epoll_event *)realloc(backend->events, sizeof(struct epoll_event) * size);
+    if (!events)
+        return; // Keep polling with the current array
+
+    backend->events = events;
+    backend->max_events = size;
+}
+
+static inline uint32_t ev_epoll_mask(int events)
+{
+    return (events & EV_READ ? EPOLLIN : 0) | (events & EV_WRITE ? EPOLLOUT : 0) |
+           (events & EV_ET ? EPOLLET : 0) | (events & EV_ONESHOT ? EPOLLONESHOT : 0);
 }
 
-// Dispatch events
-void ev_backend_dispatch(ev_backend_t *backend)
+// EV_READ / EV_WRITE side of reported events, errors and hangups wake both
+static inline int ev_epoll_ready(uint32_t events)
 {
-    for (int i = 0; i < backend->max_events; i++)
+    return (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR) ? EV_READ : 0) |
+           (events & (EPOLLOUT | EPOLLHUP | EPOLLERR) ? EV_WRITE : 0) | (events & EPOLLERR ? EV_READY_ERROR : 0);
+}
+
+// Make sure fd has a slot in the fd table
+static int ev_epoll_fd_reserve(ev_epoll_t *backend, int fd)
+{
+    if (fd < backend->fd_capacity)
+        return 0;
+
+    int capacity = backend->fd_capacity ? backend->fd_capacity : 64;
+    while (capacity <= fd)
+        capacity *= 2;
+
+    ev_epoll_fd_t *fds = (ev_epoll_fd_t *)realloc(backend->fds, sizeof(ev_epoll_fd_t) * capacity);
+    if (!fds)
     {
-        struct epoll_event *ev = &backend->events[i];
+        perror("Failed to grow fd table");
+        return -1;
+    }
+    memset(fds + backend->fd_capacity, 0, sizeof(ev_epoll_fd_t) * (capacity - backend->fd_capacity));
+
+    backend->fds = fds;
+    backend->fd_capacity = capacity;
+    return 0;
+}
+
+// Queue fd for the next changelist flush, once
+static void ev_epoll_fd_change(ev_epoll_t *backend, int fd)
+{
+    if (backend->fds[fd].changed)
+        return;
+
+    if (backend->change_count == backend->change_capacity)
+    {
+        int capacity = backend->change_capacity ? backend->change_capacity * 2 : 64;
+        int *changes = (int *)realloc(backend->changes, sizeof(int) * capacity);
+        if (!changes)
+        {
+            perror("Failed to grow changelist");
+            return;
+        }
+        backend->changes = changes;
+        backend->change_capacity = capacity;
+    }
+
+    backend->changes[backend->change_count++] = fd;
+    backend->fds[fd].changed = true;
+}
+
+// Bring the kernel's interest set in line with the fd table
+static void ev_epoll_flush_changes(ev_epoll_t *backend)
+{
+    for (int i = 0; i < backend->change_count; i++)
+    {
+        int fd = backend->changes[i];
+        ev_epoll_fd_t *state = &backend->fds[fd];
+        ev_io_t *watcher = state->watcher;
 
-        if (ev->data.ptr)
+        state->changed = false;
+
+        if (!watcher || !watcher->active)
         {
-            if (((ev_io_t *)ev->data.ptr)->type == IO_EVENT)
+            // fd may already be closed, which drops it from the set anyway
+            if (state->registered)
+                epoll_ctl(backend->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            state->registered = false;
+            state->kernel = 0;
+            continue;
+        }
+
+        uint32_t mask = ev_epoll_mask(watcher->events);
+        if (state->registered && state->kernel == mask)
+            continue; // Coalesced back to what the kernel already has
+
+        struct epoll_event ev = {0};
+        ev.events = mask;
+        ev.data.fd = fd;
+
+        // Retry with the other op if the table is stale (fd closed or reused)
+        int op = state->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (epoll_ctl(backend->epoll_fd, op, fd, &ev) == -1)
+        {
+            op = (errno == ENOENT) ? EPOLL_CTL_ADD : (errno == EEXIST) ? EPOLL_CTL_MOD : -1;
+            if (op == -1 || epoll_ctl(backend->epoll_fd, op, fd, &ev) == -1)
             {
-                ev_io_t *watcher = (ev_io_t *)ev->data.ptr;
-                watcher->callback(watcher, ev->events); // Call user callback
+                perror("epoll_ctl");
+                continue;
             }
-            else if (((ev_timer_t *)ev->data.ptr)->type == TIMER_EVENT)
-            {
-                ev_timer_t *timer = (ev_timer_t *)ev->data.ptr;
+        }
 
-                // Skip if the timer is no longer active
-                if (!timer->active)
-                {
-                    continue;
-                }
+        state->registered = true;
+        state->kernel = mask;
+    }
+    backend->change_count = 0;
+}
 
-                uint64_t expirations;
-                read(timer->ident, &expirations, sizeof(expirations)); // Clear the timer
+// Poll backend for events
+static int ev_epoll_poll(ev_backend_t *base, int timeout)
+{
+    ev_epoll_t *backend = (ev_epoll_t *)base;
+    ev_epoll_flush_changes(backend);
 
-                timer->callback(timer, 0); // Call timer callback
+    int ready = epoll_wait(backend->epoll_fd, backend->events, backend->max_events, timeout);
+    if (ready >= 0)
+    {
+        ev_epoll_tune_events(backend, ready);
+    }
+    return ready;
+}
 
-                if (timer->repeat == 0)
-                {
-                    ev_backend_unregister_timer(backend, timer); // Stop one-shot timer
-                }
-            }
+// Dispatch events: I/O watchers are queued on `pending`, everything else is called right away
+static void ev_epoll_dispatch(ev_backend_t *base, int ready, ev_pending_queue_t *pending)
+{
+    ev_epoll_t *backend = (ev_epoll_t *)base;
+    backend->ready_events = ready;
+    for (backend->ready_index = 0; backend->ready_index < backend->ready_events; backend->ready_index++)
+    {
+        struct epoll_event *ev = &backend->events[backend->ready_index];
+        ev_epoll_fd_t *state = &backend->fds[ev->data.fd];
+        ev_io_t *watcher = state->watcher;
+
+        // Skip watchers stopped by an earlier callback in this batch
+        if (!watcher || !watcher->active)
+            continue;
+
+        // The kernel disarmed the fd, stop the watcher but keep the fd
+        // registered so a restart is a single MOD
+        if (watcher->events & EV_ONESHOT)
+        {
+            watcher->active = false;
+            state->watcher = NULL;
+            state->kernel = 0;
+            backend->active_watcher_count--;
         }
+
+        ev_pending_feed(pending, watcher, ev->events, ev_epoll_ready(ev->events)); // Called by priority once the batch is queued
     }
+    backend->ready_events = 0;
 }
 
 // Check if backend has pending tasks
-int ev_backend_is_empty(ev_backend_t *backend)
+static int ev_epoll_is_empty(ev_backend_t *base)
 {
+    ev_epoll_t *backend = (ev_epoll_t *)base;
     if (backend->active_watcher_count == 0)
     {
         return 1;
@@ -118,83 +307,128 @@ int ev_backend_is_empty(ev_backend_t *backend)
     return 0; // For now, assume not empty
 }
 
+static int ev_epoll_active_count(ev_backend_t *base)
+{
+    ev_epoll_t *backend = (ev_epoll_t *)base;
+    return backend->active_watcher_count;
+}
+
 // Register I/O event
-void ev_backend_register_io(ev_backend_t *backend, ev_io_t *watcher)
+static void ev_epoll_register_io(ev_backend_t *base, ev_io_t *watcher)
 {
+    ev_epoll_t *backend = (ev_epoll_t *)base;
     if (!backend || !watcher)
         return;
 
-    struct epoll_event ev = {0};
-    ev.events = (watcher->events & EV_READ ? EPOLLIN : 0) | (watcher->events & EV_WRITE ? EPOLLOUT : 0);
-    ev.data.ptr = watcher;
+    if (ev_epoll_fd_reserve(backend, watcher->fd) != 0)
+    {
+        watcher->active = false;
+        return;
+    }
 
-    if (epoll_ctl(backend->epoll_fd, EPOLL_CTL_ADD, watcher->fd, &ev) == -1)
+    ev_epoll_fd_t *state = &backend->fds[watcher->fd];
+    if (state->watcher && state->watcher != watcher)
     {
-        perror("epoll_ctl ADD");
+        fprintf(stderr, "fd %d already has an active watcher\n", watcher->fd);
+        watcher->active = false;
+        return;
     }
+
+    state->watcher = watcher;
+    ev_epoll_fd_change(backend, watcher->fd);
     backend->active_watcher_count++;
 }
 
-void ev_backend_unregister_io(ev_backend_t *backend, ev_io_t *watcher)
+static void ev_epoll_unregister_io(ev_backend_t *base, ev_io_t *watcher)
 {
+    ev_epoll_t *backend = (ev_epoll_t *)base;
     if (!backend || !watcher)
         return;
 
-    if (epoll_ctl(backend->epoll_fd, EPOLL_CTL_DEL, watcher->fd, NULL) == -1)
-    {
-        perror("epoll_ctl DEL");
-    }
+    if (watcher->fd >= backend->fd_capacity || backend->fds[watcher->fd].watcher != watcher)
+        return;
+
+    backend->fds[watcher->fd].watcher = NULL;
+    ev_epoll_fd_change(backend, watcher->fd);
     backend->active_watcher_count--;
 }
 
-int ev_backend_register_timer(ev_backend_t *backend, ev_timer_t *timer)
+// Change an active watcher's interest, folded into the next flush
+static void ev_epoll_modify_io(ev_backend_t *base, ev_io_t *watcher, int events)
 {
-    struct itimerspec ts;
-    ts.it_value.tv_sec = (time_t)timer->after;
-    ts.it_value.tv_nsec = (long)((timer->after - ts.it_value.tv_sec) * 1e9);
-    ts.it_interval.tv_sec = (time_t)timer->repeat;
-    ts.it_interval.tv_nsec = (long)((timer->repeat - ts.it_interval.tv_sec) * 1e9);
-
-    timer->ident = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
-    if (timer->ident == -1)
+    ev_epoll_t *backend = (ev_epoll_t *)base;
+    watcher->events = events;
+    if (watcher->fd < backend->fd_capacity && backend->fds[watcher->fd].watcher == watcher)
     {
-        perror("timerfd_create");
-        return -1;
+        ev_epoll_fd_change(backend, watcher->fd);
     }
+}
 
-    if (timerfd_settime(timer->ident, 0, &ts, NULL) == -1)
-    {
-        perror("timerfd_settime");
-        close(timer->ident);
-        return -1;
-    }
+// No native completion API, the loop emulates requests on top of readiness
+static int ev_epoll_submit(ev_backend_t *base, ev_req_t *req)
+{
+    (void)base;
+    (void)req;
+    return -ENOSYS;
+}
 
-    struct epoll_event ev = {0};
-    ev.events = EPOLLIN;
-    ev.data.ptr = timer;
+// Buffers are handed out by the loop on readiness, nothing to register
+static int ev_epoll_buf_pool_register(ev_backend_t *base, ev_buf_pool_t *pool)
+{
+    (void)base;
+    (void)pool;
+    return -ENOSYS;
+}
 
-    if (epoll_ctl(backend->epoll_fd, EPOLL_CTL_ADD, timer->ident, &ev) == -1)
-    {
-        perror("epoll_ctl ADD timer");
-        close(timer->ident);
-        return -1;
-    }
+static void ev_epoll_buf_pool_unregister(ev_backend_t *base, ev_buf_pool_t *pool)
+{
+    (void)base;
+    (void)pool;
+}
 
-    backend->active_watcher_count++;
-    timer->active = 1;
-    return 0;
+static void ev_epoll_buf_pool_recycle(ev_backend_t *base, ev_buf_pool_t *pool, unsigned id)
+{
+    (void)base;
+    (void)pool;
+    (void)id;
 }
 
-int ev_backend_unregister_timer(ev_backend_t *backend, ev_timer_t *timer)
+// No way to post into another loop's queue, the loop writes its wakeup fd
+static int ev_epoll_notify(ev_backend_t *base, ev_backend_t *target_base, ev_io_t *watcher)
 {
-    if (epoll_ctl(backend->epoll_fd, EPOLL_CTL_DEL, timer->ident, NULL) == -1)
-    {
-        perror("epoll_ctl DEL timer");
-        return -1;
-    }
+    (void)base;
+    (void)target_base;
+    (void)watcher;
+    return -ENOSYS;
+}
 
-    close(timer->ident);
-    timer->active = 0;
-    backend->active_watcher_count--;
-    return 0;
+// Signals are read from the loop's signalfd, an ordinary I/O watcher
+static int ev_epoll_signal(ev_backend_t *base, int signum, bool enable, ev_io_t *watcher)
+{
+    (void)base;
+    (void)signum;
+    (void)enable;
+    (void)watcher;
+    return -ENOSYS;
 }
+
+static const ev_backend_ops_t ev_epoll_ops = {
+    "epoll",
+    EV_BACKEND_EPOLL,
+    ev_epoll_init,
+    ev_epoll_destroy,
+    ev_epoll_prepare,
+    ev_epoll_poll,
+    ev_epoll_dispatch,
+    ev_epoll_is_empty,
+    ev_epoll_active_count,
+    ev_epoll_register_io,
+    ev_epoll_unregister_io,
+    ev_epoll_modify_io,
+    ev_epoll_submit,
+    ev_epoll_buf_pool_register,
+    ev_epoll_buf_pool_unregister,
+    ev_epoll_buf_pool_recycle,
+    ev_epoll_notify,
+    ev_epoll_signal,
+};
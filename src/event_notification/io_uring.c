@@ -1,4 +1,4 @@
-include "libekio.h"
+#include "libekio.h"
 #include <liburing.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -6,37 +6,86 @@ include "libekio.h"
 #include <stdio.h>
 #include <string.h>
 #include <poll.h>  // For POLLIN, POLLOUT
-#include <fcntl.h> // For TFD_NONBLOCK
-#include <sys/timerfd.h>
 
-    // Backend-specific structure
-    struct ev_backend
+/*
+ * I/O watchers are armed as multishot polls (IORING_POLL_ADD_MULTI), so one
+ * SQE keeps producing a CQE per readiness change until it is removed. A poll
+ * the kernel ends by itself is armed again, one it can't be (cancelled, bad
+ * fd) stops its watcher and reaches the callback as POLLERR.
+ * Register/unregister only queue SQEs, everything queued during an iteration
+ * goes to the kernel in the single io_uring_submit_and_wait_timeout() call
+ * that also waits for completions.
+ *
+ * A removed poll can still post CQEs (readiness that raced the removal and
+ * the final -ECANCELED) after its watcher was stopped and maybe freed. Those
+ * watchers are kept in `cancels` until their last CQE has been seen, and are
+ * never dereferenced from a CQE meanwhile.
+ *
+ * A loop thread wakes another io_uring loop with IORING_OP_MSG_RING, which
+ * posts a CQE straight into the target ring without touching its eventfd.
+ */
+
+// Low bits of user_data tag CQEs that don't belong to a watcher or request
+#define EV_URING_TAG_MASK 0x3
+#define EV_URING_REMOVE_TAG 0x1 // Completion of our own poll-remove SQE
+#define EV_URING_WAKE_TAG 0x2   // Wakeup message from another ring
+#define EV_URING_SENT_TAG 0x3   // Completion of a wakeup message we sent
+
+// Backend-specific structure
+typedef struct ev_uring
 {
+    ev_backend_t base; // Must stay first, the loop only sees this part
     struct io_uring ring;
     struct io_uring_cqe **cqe;
     int max_events;
     int active_watcher_count;
-};
+    int ready_events;    // CQEs returned by the last poll still being dispatched
+    int ready_index;     // CQE currently being dispatched
+    uintptr_t *cancels;  // Stopped watchers whose poll may still post CQEs
+    int cancel_count;    // Entries used in cancels
+    int cancel_capacity; // Entries allocated in cancels
+    int next_buf_group;  // Next provided-buffer group id to hand out
+    bool msg_ring;       // Kernel supports IORING_OP_MSG_RING
+} ev_uring_t;
+
+static void ev_uring_buf_pool_recycle(ev_backend_t *base, ev_buf_pool_t *pool, unsigned id);
 
 // Initialize backend
-ev_backend_t *ev_backend_init()
+static ev_backend_t *ev_uring_init(const ev_loop_options_t *options)
 {
-    ev_backend_t *backend = (ev_backend_t *)malloc(sizeof(ev_backend_t));
+    ev_uring_t *backend = (ev_uring_t *)malloc(sizeof(ev_uring_t));
     if (!backend)
         return NULL;
 
-    int ret = io_uring_queue_init(64, &backend->ring, 0); // Initialize io_uring with max_events (64)
+    // The CQ ring bounds how many completions one peek can return, so size it
+    // for the cap rather than growing a side array later
+    int ret = io_uring_queue_init(options->max_events_cap, &backend->ring, 0);
     if (ret)
     {
-        perror("Failed to create io_uring");
+        // Unsupported or blocked by seccomp, the loop quietly falls back to epoll
         free(backend);
         return NULL;
     }
 
-    backend->max_events = 64; // Default event size
+    backend->max_events = options->max_events_cap;
 
     backend->cqe = (struct io_uring_cqe **)malloc(sizeof(struct io_uring_cqe *) * backend->max_events);
     backend->active_watcher_count = 0;
+    backend->ready_events = 0;
+    backend->ready_index = 0;
+    backend->cancels = NULL;
+    backend->cancel_count = 0;
+    backend->cancel_capacity = 0;
+    backend->next_buf_group = 0;
+    backend->msg_ring = false;
+
+    struct io_uring_probe *probe = io_uring_get_probe_ring(&backend->ring);
+    if (probe)
+    {
+        backend->msg_ring = io_uring_opcode_supported(probe, IORING_OP_MSG_RING);
+        io_uring_free_probe(probe);
+    }
+
     if (!backend->cqe)
     {
         perror("Failed to allocate CQE array");
@@ -45,81 +94,292 @@ ev_backend_t *ev_backend_init()
         return NULL;
     }
 
-    return backend;
+    return &backend->base;
 }
 
 // Destroy backend
-void ev_backend_destroy(ev_backend_t *backend)
+static void ev_uring_destroy(ev_backend_t *base)
 {
+    ev_uring_t *backend = (ev_uring_t *)base;
     if (!backend)
         return;
 
     io_uring_queue_exit(&backend->ring);
     free(backend->cqe);
+    free(backend->cancels);
     free(backend);
 }
 
 // Prepare backend (queue pending tasks, etc.)
-void ev_backend_prepare(ev_backend_t *backend)
+static void ev_uring_prepare(ev_backend_t *base)
 {
+    (void)base;
     // Prepare logic if necessary (e.g., fork watchers)
 }
 
 // Poll backend for events
-int ev_backend_poll(ev_backend_t *backend, int flags)
+static int ev_uring_poll(ev_backend_t *base, int timeout)
 {
-    int ret = io_uring_peek_batch_cqe(&backend->ring, backend->cqe, backend->max_events);
-    if (ret > 0)
+    ev_uring_t *backend = (ev_uring_t *)base;
+    int ret;
+
+    // Flush every SQE queued since the last poll and wait in the same syscall
+    if (timeout == 0)
+    {
+        ret = io_uring_submit(&backend->ring);
+    }
+    else
     {
-        // Handle events if there are any
-        return ret;
+        struct io_uring_cqe *cqe;
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000L;
+
+        ret = io_uring_submit_and_wait_timeout(&backend->ring, &cqe, 1, timeout < 0 ? NULL : &ts, NULL);
+    }
+
+    if (ret < 0 && ret != -ETIME)
+    {
+        errno = -ret;
+        return -1;
     }
-    return 0; // No events
+
+    return io_uring_peek_batch_cqe(&backend->ring, backend->cqe, backend->max_events);
 }
 
-// Dispatch events
-void ev_backend_dispatch(ev_backend_t *backend)
+// Get a free SQE, flushing the queue to the kernel if it is full
+static struct io_uring_sqe *ev_uring_get_sqe(ev_uring_t *backend)
 {
-    for (int i = 0; i < backend->max_events; i++)
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&backend->ring);
+    if (!sqe)
     {
-        if (backend->cqe)
+        io_uring_submit(&backend->ring);
+        sqe = io_uring_get_sqe(&backend->ring);
+    }
+    return sqe;
+}
+
+// Queue a multishot poll for the watcher's interest set
+static void ev_uring_arm_io(ev_uring_t *backend, ev_io_t *watcher)
+{
+    struct io_uring_sqe *sqe = ev_uring_get_sqe(backend);
+    if (!sqe)
+    {
+        perror("Failed to get SQE");
+        return;
+    }
+
+    unsigned mask = (watcher->events & EV_READ ? POLLIN : 0) | (watcher->events & EV_WRITE ? POLLOUT : 0);
+    if (watcher->events & EV_ONESHOT)
+        io_uring_prep_poll_add(sqe, watcher->fd, mask);
+    else
+        io_uring_prep_poll_multishot(sqe, watcher->fd, mask);
+
+#ifdef IORING_POLL_ADD_LEVEL
+    // io_uring polls are edge-triggered unless asked otherwise
+    if (!(watcher->events & EV_ET))
+        sqe->len |= IORING_POLL_ADD_LEVEL;
+#endif
+    io_uring_sqe_set_data64(sqe, (uintptr_t)watcher);
+}
+
+static int ev_uring_find_cancel(ev_uring_t *backend, uintptr_t data)
+{
+    for (int i = 0; i < backend->cancel_count; i++)
+    {
+        if (backend->cancels[i] == data)
+            return i;
+    }
+    return -1;
+}
+
+static void ev_uring_drop_cancel(ev_uring_t *backend, int index)
+{
+    backend->cancels[index] = backend->cancels[--backend->cancel_count];
+}
+
+static int ev_uring_add_cancel(ev_uring_t *backend, uintptr_t data)
+{
+    if (backend->cancel_count == backend->cancel_capacity)
+    {
+        int capacity = backend->cancel_capacity ? backend->cancel_capacity * 2 : 16;
+        uintptr_t *cancels = (uintptr_t *)realloc(backend->cancels, sizeof(uintptr_t) * capacity);
+        if (!cancels)
+            return -1;
+        backend->cancels = cancels;
+        backend->cancel_capacity = capacity;
+    }
+    backend->cancels[backend->cancel_count++] = data;
+    return 0;
+}
+
+// EV_READ / EV_WRITE side of a poll result, errors and hangups wake both
+static inline int ev_uring_ready(int res)
+{
+    return (res & (POLLIN | POLLHUP | POLLERR) ? EV_READ : 0) |
+           (res & (POLLOUT | POLLHUP | POLLERR) ? EV_WRITE : 0) | (res & POLLERR ? EV_READY_ERROR : 0);
+}
+
+// A poll the kernel ended with an error is worth arming again (-ENOBUFS,
+// -ENOMEM, ...) unless the error would only repeat: the poll was cancelled
+// under us or the fd is no good
+static inline bool ev_uring_poll_retry(int res)
+{
+    return res != -ECANCELED && res != -EBADF && res != -EINVAL;
+}
+
+// Dispatch events: I/O watchers are queued on `pending`, everything else is called right away
+static void ev_uring_dispatch(ev_backend_t *base, int ready, ev_pending_queue_t *pending)
+{
+    ev_uring_t *backend = (ev_uring_t *)base;
+    backend->ready_events = ready;
+    for (backend->ready_index = 0; backend->ready_index < backend->ready_events; backend->ready_index++)
+    {
+        struct io_uring_cqe *cqe = backend->cqe[backend->ready_index];
+        if (!cqe || !cqe->user_data)
+            continue;
+
+        uintptr_t data = (uintptr_t)io_uring_cqe_get_data64(cqe);
+        bool more = cqe->flags & IORING_CQE_F_MORE;
+
+        // Our poll-remove finished; if it found nothing the target poll had
+        // already ended and no further CQE will come for it
+        if ((data & EV_URING_TAG_MASK) == EV_URING_REMOVE_TAG)
+        {
+            int index = ev_uring_find_cancel(backend, data & ~(uintptr_t)EV_URING_TAG_MASK);
+            if (cqe->res < 0 && index >= 0)
+                ev_uring_drop_cancel(backend, index);
+            continue;
+        }
+
+        // Another loop woke us, the watcher's fd was not written to
+        if ((data & EV_URING_TAG_MASK) == EV_URING_WAKE_TAG)
         {
-            struct io_uring_cqe *cqe = backend->cqe[i];
-            if (cqe && cqe->user_data)
+            ev_io_t *watcher = (ev_io_t *)(data & ~(uintptr_t)EV_URING_TAG_MASK);
+            if (watcher->active)
+                watcher->callback(watcher, 0);
+            continue;
+        }
+
+        // Our wakeup message could not be delivered, fall back to the target's eventfd
+        if ((data & EV_URING_TAG_MASK) == EV_URING_SENT_TAG)
+        {
+            if (cqe->res < 0)
             {
-                int type = ((ev_io_t *)cqe->user_data)->type;
-                if (type == IO_EVENT)
-                {
-                    ev_io_t *watcher = (ev_io_t *)cqe->user_data;
-                    watcher->callback(watcher, cqe->res); // Call user callback
-                }
-                else if (type == TIMER_EVENT)
-                {
-                    ev_timer_t *timer = (ev_timer_t *)cqe->user_data;
-                    // Skip if the timer is no longer active
-                    if (!timer->active)
-                    {
-                        continue;
-                    }
+                ev_io_t *watcher = (ev_io_t *)(data & ~(uintptr_t)EV_URING_TAG_MASK);
+                uint64_t one = 1;
+                if (write(watcher->fd, &one, sizeof(one)) == -1)
+                    perror("Failed to wake loop");
+            }
+            continue;
+        }
 
-                    uint64_t expirations;
-                    read(timer->ident, &expirations, sizeof(expirations)); // Clear the timer
+        // Late CQE of a removed poll, the watcher may be gone
+        if (backend->cancel_count > 0)
+        {
+            int index = ev_uring_find_cancel(backend, data);
+            if (index >= 0)
+            {
+                if (!more)
+                    ev_uring_drop_cancel(backend, index);
+                continue;
+            }
+        }
 
-                    timer->callback(timer, 0); // Call timer callback
+        // Completion of an async request
+        if (((ev_req_t *)data)->type == REQ_EVENT)
+        {
+            ev_req_t *req = (ev_req_t *)data;
 
-                    if (timer->repeat == 0)
+            // Zero-copy send: the first CQE has the result, the F_NOTIF one
+            // says the kernel let go of the buffer
+            if (req->op == EV_OP_SEND_ZC && !(cqe->flags & IORING_CQE_F_NOTIF))
+            {
+                req->result = cqe->res;
+                if (more)
+                    continue;
+            }
+
+            req->active = false;
+            backend->active_watcher_count--;
+
+            // The kernel picked a buffer from the pool's ring, lend it to the callback
+            if (req->op == EV_OP_READ_POOLED)
+            {
+                req->buf = NULL;
+                req->len = 0;
+                if (cqe->flags & IORING_CQE_F_BUFFER)
+                {
+                    unsigned id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                    req->buf = req->pool->base + (size_t)id * req->pool->buf_size;
+                    req->len = cqe->res > 0 ? cqe->res : 0;
+                    if (cqe->res <= 0)
                     {
-                        ev_backend_unregister_timer(backend, timer); // Stop one-shot timer
+                        ev_uring_buf_pool_recycle(&backend->base, req->pool, id);
+                        req->buf = NULL;
                     }
                 }
             }
+
+            req->callback(req, req->op == EV_OP_SEND_ZC ? req->result : cqe->res);
+            continue;
+        }
+
+        ev_io_t *watcher = (ev_io_t *)data;
+
+        // Skip watchers stopped by an earlier callback in this batch
+        if (!watcher->active)
+            continue;
+
+        bool retry = cqe->res > 0 || ev_uring_poll_retry(cqe->res);
+        if (watcher->events & EV_ONESHOT)
+        {
+            // Single-shot poll is finished, stop the watcher
+            watcher->active = false;
+            backend->active_watcher_count--;
+        }
+        else if (!more && retry)
+        {
+            // The kernel ended the multishot poll (e.g. CQ overflow), arm it again
+            ev_uring_arm_io(backend, watcher);
+        }
+        else if (!more && watcher->type != FD_SHARED_EVENT)
+        {
+            // Nothing left to watch, stop the watcher like a fired one-shot.
+            // A shared registration stays with the fd table, its watchers
+            // hear about the error and stop it.
+            watcher->active = false;
+            backend->active_watcher_count--;
+        }
+
+        if (cqe->res > 0)
+            ev_pending_feed(pending, watcher, cqe->res, ev_uring_ready(cqe->res)); // Called by priority once the batch is queued
+        else if (cqe->res < 0 && (!retry || (watcher->events & EV_ONESHOT)))
+            ev_pending_feed(pending, watcher, POLLERR, ev_uring_ready(POLLERR)); // The poll is gone, say so
+    }
+    backend->ready_events = 0;
+
+    // Hand the consumed CQEs back to the kernel
+    io_uring_cq_advance(&backend->ring, ready);
+}
+
+// Drop a stopped watcher from the rest of the batch being dispatched,
+// its memory may be released before we get to it
+static void ev_uring_forget_ready(ev_uring_t *backend, ev_io_t *watcher)
+{
+    for (int i = backend->ready_index + 1; i < backend->ready_events; i++)
+    {
+        if (backend->cqe[i] && backend->cqe[i]->user_data == (uintptr_t)watcher)
+        {
+            backend->cqe[i] = NULL;
         }
     }
 }
 
 // Check if backend has pending tasks
-int ev_backend_is_empty(ev_backend_t *backend)
+static int ev_uring_is_empty(ev_backend_t *base)
 {
+    ev_uring_t *backend = (ev_uring_t *)base;
     if (backend->active_watcher_count == 0)
     {
         return 1;
@@ -128,122 +388,224 @@ int ev_backend_is_empty(ev_backend_t *backend)
     return 0; // For now, assume not empty
 }
 
+static int ev_uring_active_count(ev_backend_t *base)
+{
+    ev_uring_t *backend = (ev_uring_t *)base;
+    return backend->active_watcher_count;
+}
+
 // Register I/O event
-void ev_backend_register_io(ev_backend_t *backend, ev_io_t *watcher)
+static void ev_uring_register_io(ev_backend_t *base, ev_io_t *watcher)
 {
+    ev_uring_t *backend = (ev_uring_t *)base;
     if (!backend || !watcher)
         return;
 
-    struct io_uring_sqe *sqe = io_uring_get_sqe(&backend->ring);
-    if (!sqe)
-    {
-        perror("Failed to get SQE");
-        return;
-    }
-
-    // Set up I/O event
-    if (watcher->events & EV_READ)
-    {
-        io_uring_prep_poll_add(sqe, watcher->fd, POLLIN);
-    }
-    if (watcher->events & EV_WRITE)
-    {
-        io_uring_prep_poll_add(sqe, watcher->fd, POLLOUT);
-    }
-
-    sqe->user_data = watcher; // Store user data
-
-    int ret = io_uring_submit(&backend->ring);
-    if (ret < 0)
-    {
-        perror("io_uring_submit ADD IO event");
-    }
+    // Queued only, submitted with the next poll
+    ev_uring_arm_io(backend, watcher);
     backend->active_watcher_count++;
 }
 
-void ev_backend_unregister_io(ev_backend_t *backend, ev_io_t *watcher)
+static void ev_uring_unregister_io(ev_backend_t *base, ev_io_t *watcher)
 {
+    ev_uring_t *backend = (ev_uring_t *)base;
     if (!backend || !watcher)
         return;
 
-    struct io_uring_sqe *sqe = io_uring_get_sqe(&backend->ring);
+    struct io_uring_sqe *sqe = ev_uring_get_sqe(backend);
     if (!sqe)
     {
         perror("Failed to get SQE");
         return;
     }
 
-    // Remove the I/O event
-    io_uring_prep_poll_remove(sqe, watcher->fd);
+    // Remove the multishot poll by the user_data it was armed with
+    io_uring_prep_poll_remove(sqe, (uintptr_t)watcher);
+    io_uring_sqe_set_data64(sqe, (uintptr_t)watcher | EV_URING_REMOVE_TAG);
 
-    int ret = io_uring_submit(&backend->ring);
-    if (ret < 0)
+    if (ev_uring_add_cancel(backend, (uintptr_t)watcher) != 0)
     {
-        perror("io_uring_submit DEL IO event");
+        perror("Failed to track io_uring poll removal");
     }
+    ev_uring_forget_ready(backend, watcher);
     backend->active_watcher_count--;
 }
 
-int ev_backend_register_timer(ev_backend_t *backend, ev_timer_t *timer)
+// Change the interest of an armed poll, in place for edge-triggered ones
+static void ev_uring_modify_io(ev_backend_t *base, ev_io_t *watcher, int events)
 {
-    struct itimerspec ts;
-    ts.it_value.tv_sec = (time_t)timer->after;
-    ts.it_value.tv_nsec = (long)((timer->after - ts.it_value.tv_sec) * 1e9);
-    ts.it_interval.tv_sec = (time_t)timer->repeat;
-    ts.it_interval.tv_nsec = (long)((timer->repeat - ts.it_interval.tv_sec) * 1e9);
+    ev_uring_t *backend = (ev_uring_t *)base;
+    int mode = EV_ET | EV_ONESHOT;
 
-    timer->ident = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
-
-    if (timer->ident == -1)
-    {
-        perror("timerfd_create");
-        return -1;
-    }
-    if (timerfd_settime(timer->ident, 0, &ts, NULL) == -1)
+    // Trigger mode can't be updated in place, replace the poll instead. Nor can
+    // a level-triggered poll be kept: the kernel refuses IORING_POLL_ADD_LEVEL
+    // on updates and makes the updated poll edge-triggered without it
+    if ((watcher->events & mode) != (events & mode) || !(events & EV_ET))
     {
-        perror("timerfd_settime");
-        close(timer->ident);
-        return -1;
+        ev_uring_unregister_io(base, watcher);
+        watcher->events = events;
+        ev_uring_register_io(base, watcher);
+        return;
     }
-    struct io_uring_sqe *sqe = io_uring_get_sqe(&backend->ring);
+
+    struct io_uring_sqe *sqe = ev_uring_get_sqe(backend);
     if (!sqe)
     {
-        perror("Failed to get SQE for timer");
-        return -1;
+        perror("Failed to get SQE");
+        return;
     }
-    io_uring_prep_poll_add(sqe, timer->ident, POLLIN);
-    sqe->user_data = (uintptr_t)timer;
-    int ret = io_uring_submit(&backend->ring);
-    if (ret < 0)
+
+    watcher->events = events;
+    unsigned mask = (events & EV_READ ? POLLIN : 0) | (events & EV_WRITE ? POLLOUT : 0);
+    unsigned flags = IORING_POLL_UPDATE_EVENTS | (events & EV_ONESHOT ? 0 : IORING_POLL_ADD_MULTI);
+    io_uring_prep_poll_update(sqe, (uintptr_t)watcher, (uintptr_t)watcher, mask, flags);
+    io_uring_sqe_set_data64(sqe, 0); // Completion of the update itself is not interesting
+}
+
+// Queue an async request as its native io_uring operation
+static int ev_uring_submit(ev_backend_t *base, ev_req_t *req)
+{
+    ev_uring_t *backend = (ev_uring_t *)base;
+    struct io_uring_sqe *sqe = ev_uring_get_sqe(backend);
+    if (!sqe)
+        return -EAGAIN;
+
+    switch (req->op)
     {
-        perror("io_uring_submit ADD timer");
-        close(timer->ident);
-        return -1;
+    case EV_OP_READ:
+        io_uring_prep_read(sqe, req->fd, req->buf, req->len, (__u64)-1);
+        break;
+    case EV_OP_WRITE:
+        io_uring_prep_write(sqe, req->fd, req->buf, req->len, (__u64)-1);
+        break;
+    case EV_OP_ACCEPT:
+        io_uring_prep_accept(sqe, req->fd, req->addr, req->addrlen, 0);
+        break;
+    case EV_OP_CONNECT:
+        io_uring_prep_connect(sqe, req->fd, req->addr, req->addr_size);
+        break;
+    case EV_OP_SENDMSG:
+        io_uring_prep_sendmsg(sqe, req->fd, req->msg, req->flags);
+        break;
+    case EV_OP_SEND_ZC:
+        io_uring_prep_send_zc(sqe, req->fd, req->buf, req->len, 0, 0);
+        break;
+    case EV_OP_READ_POOLED:
+        if (req->pool->group < 0)
+        {
+            // Pool has no buffer ring, fall back to the loop's emulation
+            io_uring_prep_nop(sqe);
+            io_uring_sqe_set_data64(sqe, 0);
+            return -ENOSYS;
+        }
+        io_uring_prep_read(sqe, req->fd, NULL, req->pool->buf_size, (__u64)-1);
+        io_uring_sqe_set_flags(sqe, IOSQE_BUFFER_SELECT);
+        sqe->buf_group = req->pool->group;
+        break;
+    default:
+        io_uring_prep_nop(sqe); // The SQE is already taken, don't leave it half set up
+        io_uring_sqe_set_data64(sqe, 0);
+        return -EINVAL;
     }
+
+    // Submitted together with everything else at the next poll
+    io_uring_sqe_set_data64(sqe, (uintptr_t)req);
     backend->active_watcher_count++;
-    timer->active = 1;
     return 0;
 }
 
-int ev_backend_unregister_timer(ev_backend_t *backend, ev_timer_t *timer)
+// Hand the pool's buffers to the kernel as a provided buffer ring
+static int ev_uring_buf_pool_register(ev_backend_t *base, ev_buf_pool_t *pool)
 {
-    struct io_uring_sqe *sqe = io_uring_get_sqe(&backend->ring);
-    if (!sqe)
+    ev_uring_t *backend = (ev_uring_t *)base;
+    int ret;
+    int group = backend->next_buf_group;
+
+    struct io_uring_buf_ring *ring = io_uring_setup_buf_ring(&backend->ring, pool->count, group, 0, &ret);
+    if (!ring)
     {
-        perror("Failed to get SQE for timer removal");
-        return -1;
+        return ret; // Old kernel, the loop hands out buffers instead
     }
 
-    io_uring_prep_poll_remove(sqe, timer->ident);
-    int ret = io_uring_submit(&backend->ring);
-    if (ret < 0)
+    int mask = io_uring_buf_ring_mask(pool->count);
+    for (unsigned id = 0; id < pool->count; id++)
     {
-        perror("io_uring_submit DEL timer");
-        return -1;
+        io_uring_buf_ring_add(ring, pool->base + (size_t)id * pool->buf_size, pool->buf_size, id, mask, id);
     }
+    io_uring_buf_ring_advance(ring, pool->count);
 
-    close(timer->ident);
-    timer->active = 0;
-    backend->active_watcher_count--;
+    backend->next_buf_group++;
+    pool->group = group;
+    pool->ring = ring;
+    pool->free_count = 0; // The kernel owns the idle buffers now
     return 0;
 }
+
+static void ev_uring_buf_pool_unregister(ev_backend_t *base, ev_buf_pool_t *pool)
+{
+    ev_uring_t *backend = (ev_uring_t *)base;
+    io_uring_free_buf_ring(&backend->ring, (struct io_uring_buf_ring *)pool->ring, pool->count, pool->group);
+    pool->ring = NULL;
+    pool->group = -1;
+}
+
+// Return a borrowed buffer to the kernel's ring
+static void ev_uring_buf_pool_recycle(ev_backend_t *base, ev_buf_pool_t *pool, unsigned id)
+{
+    (void)base;
+    struct io_uring_buf_ring *ring = (struct io_uring_buf_ring *)pool->ring;
+
+    io_uring_buf_ring_add(ring, pool->base + (size_t)id * pool->buf_size, pool->buf_size, id, io_uring_buf_ring_mask(pool->count), 0);
+    io_uring_buf_ring_advance(ring, 1);
+}
+
+// Wake `watcher` of the loop owning `target` with a message from our ring
+static int ev_uring_notify(ev_backend_t *base, ev_backend_t *target_base, ev_io_t *watcher)
+{
+    ev_uring_t *backend = (ev_uring_t *)base;
+    ev_uring_t *target = (ev_uring_t *)target_base;
+    if (!backend->msg_ring)
+        return -ENOSYS;
+
+    struct io_uring_sqe *sqe = ev_uring_get_sqe(backend);
+    if (!sqe)
+        return -EBUSY;
+
+    io_uring_prep_msg_ring(sqe, target->ring.ring_fd, 0, (uintptr_t)watcher | EV_URING_WAKE_TAG, 0);
+    io_uring_sqe_set_data64(sqe, (uintptr_t)watcher | EV_URING_SENT_TAG);
+
+    // Don't hold the wakeup back until our own next poll
+    int ret = io_uring_submit(&backend->ring);
+    return ret < 0 ? ret : 0;
+}
+
+// Signals are read from the loop's signalfd, an ordinary I/O watcher
+static int ev_uring_signal(ev_backend_t *base, int signum, bool enable, ev_io_t *watcher)
+{
+    (void)base;
+    (void)signum;
+    (void)enable;
+    (void)watcher;
+    return -ENOSYS;
+}
+
+static const ev_backend_ops_t ev_uring_ops = {
+    "io_uring",
+    EV_BACKEND_IO_URING,
+    ev_uring_init,
+    ev_uring_destroy,
+    ev_uring_prepare,
+    ev_uring_poll,
+    ev_uring_dispatch,
+    ev_uring_is_empty,
+    ev_uring_active_count,
+    ev_uring_register_io,
+    ev_uring_unregister_io,
+    ev_uring_modify_io,
+    ev_uring_submit,
+    ev_uring_buf_pool_register,
+    ev_uring_buf_pool_unregister,
+    ev_uring_buf_pool_recycle,
+    ev_uring_notify,
+    ev_uring_signal,
+};
@@ -4,21 +4,52 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
+/*
+ * Interest changes are appended to a changelist instead of calling kevent()
+ * per watcher. The last pending change per (fd, filter) wins, found through
+ * a per-fd table of changelist slots, and the whole list goes to the kernel
+ * in one kevent() call right before polling.
+ */
+
+// Receipts make every change report back instead of failing the whole call
+#ifndef EV_RECEIPT
+#define EV_RECEIPT 0
+#endif
+
+// Pending changes of an fd, slot in the changelist plus one, 0 for none
+typedef struct ev_kqueue_fd
+{
+    int read_change;
+    int write_change;
+} ev_kqueue_fd_t;
+
 // Backend-specific structure
-struct ev_backend
+typedef struct ev_kqueue
 {
+    ev_backend_t base; // Must stay first, the loop only sees this part
     int kqueue_fd;
     struct kevent *events;
     int max_events;
+    int min_events;  // Size the events array shrinks back to
+    int cap_events;  // Size the events array may grow to
+    int quiet_polls; // Consecutive polls that used under a quarter of the array
     int active_watcher_count;
-};
+    int ready_events; // Events returned by the last poll still being dispatched
+    int ready_index;  // Slot currently being dispatched
+    struct kevent *changes; // Pending interest changes
+    int change_count;       // Entries used in changes
+    int change_capacity;    // Entries allocated in changes
+    ev_kqueue_fd_t *fds;    // Pending changes by fd
+    int fd_capacity;        // Entries allocated in fds
+} ev_kqueue_t;
 
 // Initialize backend
-ev_backend_t *ev_backend_init()
+static ev_backend_t *ev_kqueue_init(const ev_loop_options_t *options)
 {
-    ev_backend_t *backend = (ev_backend_t *)malloc(sizeof(ev_backend_t));
+    ev_kqueue_t *backend = (ev_kqueue_t *)malloc(sizeof(ev_kqueue_t));
     if (!backend)
         return NULL;
 
@@ -30,9 +61,19 @@ ev_backend_t *ev_backend_init()
         return NULL;
     }
 
-    backend->max_events = 64; // Default event size
+    backend->max_events = options->max_events;
+    backend->min_events = options->max_events;
+    backend->cap_events = options->max_events_cap;
+    backend->quiet_polls = 0;
     backend->events = (struct kevent *)malloc(sizeof(struct kevent) * backend->max_events);
     backend->active_watcher_count = 0;
+    backend->ready_events = 0;
+    backend->ready_index = 0;
+    backend->changes = NULL;
+    backend->change_count = 0;
+    backend->change_capacity = 0;
+    backend->fds = NULL;
+    backend->fd_capacity = 0;
     if (!backend->events)
     {
         perror("Failed to allocate events array");
@@ -41,91 +82,254 @@ ev_backend_t *ev_backend_init()
         return NULL;
     }
 
-    return backend;
+    return &backend->base;
 }
 
 // Destroy backend
-void ev_backend_destroy(ev_backend_t *backend)
+static void ev_kqueue_destroy(ev_backend_t *base)
 {
+    ev_kqueue_t *backend = (ev_kqueue_t *)base;
     if (!backend)
         return;
 
     close(backend->kqueue_fd);
     free(backend->events);
+    free(backend->changes);
+    free(backend->fds);
     free(backend);
 }
 
 // Prepare backend (queue pending tasks, etc.)
-void ev_backend_prepare(ev_backend_t *backend)
+static void ev_kqueue_prepare(ev_backend_t *base)
 {
+    (void)base;
     // Prepare logic if necessary (e.g., fork watchers)
 }
 
-// Poll backend for events
-int ev_backend_poll(ev_backend_t *backend, int flags)
+// Grow the events array when a poll filled it, shrink it back after a quiet stretch.
+// Only called between poll and dispatch with `ready` events in the array, which
+// realloc preserves in both directions.
+static void ev_kqueue_tune_events(ev_kqueue_t *backend, int ready)
 {
-    // printf("EV backend Polll");
-    struct timespec timeout = {0, 0};
-    if (!(flags & EVRUN_NOWAIT))
+    int size = backend->max_events;
+
+    if (ready == backend->max_events && backend->max_events < backend->cap_events)
     {
-        timeout.tv_sec = 1; // Default 1-second timeout
+        size = backend->max_events * 2;
+        if (size > backend->cap_events)
+            size = backend->cap_events;
+        backend->quiet_polls = 0;
     }
+    else if (ready < backend->max_events / 4 && backend->max_events > backend->min_events)
+    {
+        if (++backend->quiet_polls < EV_EVENTS_SHRINK_POLLS)
+            return;
 
-    return kevent(backend->kqueue_fd, NULL, 0, backend->events, backend->max_events, &timeout);
+        size = backend->max_events / 2;
+        if (size < backend->min_events)
+            size = backend->min_events;
+        backend->quiet_polls = 0;
+    }
+    else
+    {
+        backend->quiet_polls = 0;
+        return;
+    }
+
+    if (size == backend->max_events)
+        return;
+
+    struct kevent *events = (struct kevent *)realloc(backend->events, sizeof(struct kevent) * size);
+    if (!events)
+        return; // Keep polling with the current array
+
+    backend->events = events;
+    backend->max_events = size;
 }
 
-// Dispatch events
-void ev_backend_dispatch(ev_backend_t *backend)
+// Make sure fd has a slot in the fd table
+static int ev_kqueue_fd_reserve(ev_kqueue_t *backend, int fd)
 {
-    // printf("EV Max Events %d\n", backend->kqueue_fd);
-    for (int i = 0; i < backend->max_events; i++)
+    if (fd < backend->fd_capacity)
+        return 0;
+
+    int capacity = backend->fd_capacity ? backend->fd_capacity : 64;
+    while (capacity <= fd)
+        capacity *= 2;
+
+    ev_kqueue_fd_t *fds = (ev_kqueue_fd_t *)realloc(backend->fds, sizeof(ev_kqueue_fd_t) * capacity);
+    if (!fds)
     {
-        struct kevent *ev = &backend->events[i];
-        // printf("Kevent ident %d\n", ev->ident);
+        perror("Failed to grow fd table");
+        return -1;
+    }
+    memset(fds + backend->fd_capacity, 0, sizeof(ev_kqueue_fd_t) * (capacity - backend->fd_capacity));
 
-        if (ev->udata)
-        {
-            // printf("ev->filter %d\n", ev->filter);
-            // here need to handle event type based on filter
+    backend->fds = fds;
+    backend->fd_capacity = capacity;
+    return 0;
+}
+
+// Where the pending change of (fd, filter) is remembered, NULL for filters
+// that are never coalesced (signals go in order, they change rarely)
+static int *ev_kqueue_change_slot(ev_kqueue_t *backend, int fd, short filter)
+{
+    if (filter != EVFILT_READ && filter != EVFILT_WRITE)
+        return NULL;
+    if (ev_kqueue_fd_reserve(backend, fd) != 0)
+        return NULL;
+    return filter == EVFILT_READ ? &backend->fds[fd].read_change : &backend->fds[fd].write_change;
+}
 
-            if (ev->filter == EVFILT_READ || ev->filter == EVFILT_WRITE)
+// Queue a change, replacing a pending one for the same fd and filter
+static void ev_kqueue_change(ev_kqueue_t *backend, int fd, short filter, u_short flags, void *udata)
+{
+    int *slot = ev_kqueue_change_slot(backend, fd, filter);
+    struct kevent *change = slot && *slot ? &backend->changes[*slot - 1] : NULL;
+
+    if (!change)
+    {
+        if (backend->change_count == backend->change_capacity)
+        {
+            int capacity = backend->change_capacity ? backend->change_capacity * 2 : 64;
+            struct kevent *changes = (struct kevent *)realloc(backend->changes, sizeof(struct kevent) * capacity);
+            if (!changes)
             {
-                ev_io_t *watcher = (ev_io_t *)ev->udata;
-                watcher->callback(watcher, ev->filter); // Call user callback
+                perror("Failed to grow changelist");
+                return;
             }
-            else if (ev->filter == EVFILT_TIMER)
+            backend->changes = changes;
+            backend->change_capacity = capacity;
+        }
+        change = &backend->changes[backend->change_count++];
+        if (slot)
+            *slot = backend->change_count;
+    }
+
+    EV_SET(change, fd, filter, flags | EV_RECEIPT, 0, 0, udata);
+}
+
+// Hand all pending changes to the kernel at once, receipts land in the same array
+static void ev_kqueue_flush_changes(ev_kqueue_t *backend)
+{
+    if (backend->change_count == 0)
+        return;
+
+    // Receipts overwrite the list, forget the slots while the changes are readable
+    for (int i = 0; i < backend->change_count; i++)
+    {
+        int *slot = ev_kqueue_change_slot(backend, (int)backend->changes[i].ident, backend->changes[i].filter);
+        if (slot)
+            *slot = 0;
+    }
+
+    struct timespec ts = {0, 0};
+    if (kevent(backend->kqueue_fd, backend->changes, backend->change_count,
+               backend->changes, backend->change_count, &ts) == -1)
+    {
+        perror("kevent changelist");
+    }
+    backend->change_count = 0;
+}
+
+// Queue the same change for the read and/or write filter of `events`
+static void ev_kqueue_change_filters(ev_kqueue_t *backend, ev_io_t *watcher, int events, u_short flags)
+{
+    if (events & EV_READ)
+        ev_kqueue_change(backend, watcher->fd, EVFILT_READ, flags, watcher);
+    if (events & EV_WRITE)
+        ev_kqueue_change(backend, watcher->fd, EVFILT_WRITE, flags, watcher);
+}
+
+static inline u_short ev_kqueue_flags(int events)
+{
+    return EV_ADD | EV_ENABLE | (events & EV_ET ? EV_CLEAR : 0) | (events & EV_ONESHOT ? EV_ONESHOT : 0);
+}
+
+// Poll backend for events
+static int ev_kqueue_poll(ev_backend_t *base, int timeout)
+{
+    ev_kqueue_t *backend = (ev_kqueue_t *)base;
+    ev_kqueue_flush_changes(backend);
+
+    // printf("EV backend Polll");
+    struct timespec ts;
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000L;
+
+    int ready = kevent(backend->kqueue_fd, NULL, 0, backend->events, backend->max_events, timeout < 0 ? NULL : &ts);
+    if (ready >= 0)
+    {
+        ev_kqueue_tune_events(backend, ready);
+    }
+    return ready;
+}
+
+// Dispatch events: I/O watchers are queued on `pending`, everything else is called right away
+static void ev_kqueue_dispatch(ev_backend_t *base, int ready, ev_pending_queue_t *pending)
+{
+    ev_kqueue_t *backend = (ev_kqueue_t *)base;
+    backend->ready_events = ready;
+    for (backend->ready_index = 0; backend->ready_index < backend->ready_events; backend->ready_index++)
+    {
+        struct kevent *ev = &backend->events[backend->ready_index];
+        ev_io_t *watcher = (ev_io_t *)ev->udata;
+
+        if (!watcher || (ev->flags & EV_ERROR))
+            continue;
+
+        // The loop's signal watcher, told which signal arrived
+        if (ev->filter == EVFILT_SIGNAL)
+        {
+            watcher->callback(watcher, (int)ev->ident);
+            continue;
+        }
+
+        // Skip watchers stopped by an earlier callback in this batch
+        if (!watcher->active)
+            continue;
+
+        // here need to handle event type based on filter
+        if (ev->filter == EVFILT_READ || ev->filter == EVFILT_WRITE)
+        {
+            // EV_ONESHOT already removed the kevent that fired, the other
+            // filter of a read and write watcher would stay armed with a
+            // udata that may be reused or freed by then
+            if (watcher->events & EV_ONESHOT)
             {
-                // printf("Timer Callback");
-                ev_timer_t *timer = (ev_timer_t *)ev->udata;
-
-                // Skip if the timer is no longer active
-                if (!timer->active)
-                {
-                    // printf("Skipping inactive timer\n");
-                    continue;
-                }
-
-                // printf("Dispatching Timer event\n");
-                timer->callback(timer, 0); // Call timer callback
-
-                //("Timer Repeat %d\n", timer->repeat);
-
-                // If it's a one-shot timer, deactivate it
-                if (timer->repeat == 0)
-                {
-                    // printf("Stopping one-shot timer\n");
-                    ev_backend_unregister_timer(backend, timer);
-                }
+                if ((watcher->events & (EV_READ | EV_WRITE)) == (EV_READ | EV_WRITE))
+                    ev_kqueue_change(backend, watcher->fd, ev->filter == EVFILT_READ ? EVFILT_WRITE : EVFILT_READ,
+                                     EV_DELETE, NULL);
+                watcher->active = false;
+                backend->active_watcher_count--;
             }
+
+            // A filter is negative and one per kevent, EV_READ / EV_WRITE is what the
+            // pending queue can merge when both filters of a watcher fire in one batch
+            int ready = ev->filter == EVFILT_READ ? EV_READ : EV_WRITE;
+            ev_pending_feed(pending, watcher, ready, ready); // Called by priority once the batch is queued
         }
     }
+    backend->ready_events = 0;
+}
 
-    // printf("EV backend Dispatch end");
+// Drop a stopped watcher from the rest of the batch being dispatched,
+// its memory may be released before we get to it
+static void ev_kqueue_forget_ready(ev_kqueue_t *backend, ev_io_t *watcher)
+{
+    for (int i = backend->ready_index + 1; i < backend->ready_events; i++)
+    {
+        if (backend->events[i].udata == watcher)
+        {
+            backend->events[i].udata = NULL;
+        }
+    }
 }
 
 // Check if backend has pending tasks
-int ev_backend_is_empty(ev_backend_t *backend)
+static int ev_kqueue_is_empty(ev_backend_t *base)
 {
+    ev_kqueue_t *backend = (ev_kqueue_t *)base;
     if (backend->active_watcher_count == 0)
     {
         return 1;
@@ -134,87 +338,107 @@ int ev_backend_is_empty(ev_backend_t *backend)
     return 0; // For now, assume not empty
 }
 
+static int ev_kqueue_active_count(ev_backend_t *base)
+{
+    ev_kqueue_t *backend = (ev_kqueue_t *)base;
+    return backend->active_watcher_count;
+}
+
 // Handle I/O events in the backend for kqueue
-void ev_backend_register_io(ev_backend_t *backend, ev_io_t *watcher)
+static void ev_kqueue_register_io(ev_backend_t *base, ev_io_t *watcher)
 {
+    ev_kqueue_t *backend = (ev_kqueue_t *)base;
     if (!backend || !watcher)
         return;
 
-    // Backend-specific code to register I/O events
-    // For kqueue
-    struct kevent ke;
-    EV_SET(&ke, watcher->fd, (watcher->events & EV_READ) ? EVFILT_READ : EVFILT_WRITE, EV_ADD | EV_ENABLE, 0, 0, watcher);
-
-    int event_add = kevent(backend->kqueue_fd, &ke, 1, NULL, 0, NULL);
-
-    if (event_add == -1)
-    {
-        perror("kevent EV_ADD");
-    }
+    ev_kqueue_change_filters(backend, watcher, watcher->events, ev_kqueue_flags(watcher->events));
     backend->active_watcher_count++;
 }
 
-void ev_backend_unregister_io(ev_backend_t *backend, ev_io_t *watcher)
+static void ev_kqueue_unregister_io(ev_backend_t *base, ev_io_t *watcher)
 {
+    ev_kqueue_t *backend = (ev_kqueue_t *)base;
     if (!backend || !watcher)
         return;
 
-    // Backend-specific code to unregister I/O events
-    // For kqueue
-    struct kevent ke;
-    EV_SET(&ke, watcher->fd, (watcher->events & EV_READ) ? EVFILT_READ : EVFILT_WRITE, EV_DELETE, 0, 0, watcher);
-    int event_remove = kevent(backend->kqueue_fd, &ke, 1, NULL, 0, NULL);
-    if (event_remove == -1)
-    {
-        perror("kevent EV_DELETE");
-    }
+    ev_kqueue_change_filters(backend, watcher, watcher->events, EV_DELETE);
+    ev_kqueue_forget_ready(backend, watcher);
     backend->active_watcher_count--;
 }
 
-int ev_backend_register_timer(ev_backend_t *backend, ev_timer_t *timer)
+// Change an active watcher's interest, folded into the next flush
+static void ev_kqueue_modify_io(ev_backend_t *base, ev_io_t *watcher, int events)
 {
-    // printf("timer->ident %d \n", timer->ident);
-    //  printf("Ev Backend Register");
-    struct kevent ke;
-    struct timespec ts;
-
-    ts.tv_sec = (time_t)timer->after;
-    ts.tv_nsec = (long)((timer->after - ts.tv_sec) * 1e9);
-
-    EV_SET(&ke, timer->ident, EVFILT_TIMER, EV_ADD | EV_ENABLE, NOTE_USECONDS,
-           ts.tv_sec * 1e6 + ts.tv_nsec / 1e3, timer);
-
-    int timer_register = kevent(backend->kqueue_fd, &ke, 1, NULL, 0, NULL);
-
-    if (timer_register == -1)
-    {
-        perror("kevent EVFILT_TIMER EV_ADD");
-        return -1;
-    }
-    backend->active_watcher_count++;
-    return 0;
+    ev_kqueue_t *backend = (ev_kqueue_t *)base;
+    // Filters no longer wanted go, the others are added or updated
+    ev_kqueue_change_filters(backend, watcher, watcher->events & ~events, EV_DELETE);
+    watcher->events = events;
+    ev_kqueue_change_filters(backend, watcher, events, ev_kqueue_flags(events));
 }
 
-int ev_backend_unregister_timer(ev_backend_t *backend, ev_timer_t *timer)
+// No native completion API, the loop emulates requests on top of readiness
+static int ev_kqueue_submit(ev_backend_t *base, ev_req_t *req)
 {
-    // printf("Ev Backend Unregister");
-    struct kevent ke;
-
-    // printf("timer->active %d\n", timer->active);
+    (void)base;
+    (void)req;
+    return -ENOSYS;
+}
 
-    EV_SET(&ke, timer->ident, EVFILT_TIMER, EV_DELETE, 0, 0, timer);
+// Buffers are handed out by the loop on readiness, nothing to register
+static int ev_kqueue_buf_pool_register(ev_backend_t *base, ev_buf_pool_t *pool)
+{
+    (void)base;
+    (void)pool;
+    return -ENOSYS;
+}
 
-    int timer_unregister = kevent(backend->kqueue_fd, &ke, 1, NULL, 0, NULL);
+static void ev_kqueue_buf_pool_unregister(ev_backend_t *base, ev_buf_pool_t *pool)
+{
+    (void)base;
+    (void)pool;
+}
 
-    if (timer_unregister == -1)
-    {
-        perror("kevent EVFILT_TIMER EV_DELETE");
-        return -1;
-    }
+static void ev_kqueue_buf_pool_recycle(ev_backend_t *base, ev_buf_pool_t *pool, unsigned id)
+{
+    (void)base;
+    (void)pool;
+    (void)id;
+}
 
-    timer->active = 0;
+// No way to post into another loop's queue, the loop writes its wakeup fd
+static int ev_kqueue_notify(ev_backend_t *base, ev_backend_t *target_base, ev_io_t *watcher)
+{
+    (void)base;
+    (void)target_base;
+    (void)watcher;
+    return -ENOSYS;
+}
 
-    // printf("Timer Deleted\n");
-    backend->active_watcher_count--;
+// Report `signum` to the loop's signal watcher, coalesced per poll
+static int ev_kqueue_signal(ev_backend_t *base, int signum, bool enable, ev_io_t *watcher)
+{
+    ev_kqueue_t *backend = (ev_kqueue_t *)base;
+    ev_kqueue_change(backend, signum, EVFILT_SIGNAL, enable ? EV_ADD | EV_ENABLE : EV_DELETE, watcher);
     return 0;
 }
+
+static const ev_backend_ops_t ev_kqueue_ops = {
+    "kqueue",
+    EV_BACKEND_KQUEUE,
+    ev_kqueue_init,
+    ev_kqueue_destroy,
+    ev_kqueue_prepare,
+    ev_kqueue_poll,
+    ev_kqueue_dispatch,
+    ev_kqueue_is_empty,
+    ev_kqueue_active_count,
+    ev_kqueue_register_io,
+    ev_kqueue_unregister_io,
+    ev_kqueue_modify_io,
+    ev_kqueue_submit,
+    ev_kqueue_buf_pool_register,
+    ev_kqueue_buf_pool_unregister,
+    ev_kqueue_buf_pool_recycle,
+    ev_kqueue_notify,
+    ev_kqueue_signal,
+};
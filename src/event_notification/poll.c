@@ -0,0 +1,304 @@
+#include "libekio.h"
+#include <poll.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Portable poll() backend, the last resort and a fine choice for a handful
+ * of fds. The pollfd array is dense, a per-fd slot table finds an fd's entry
+ * so start and stop stay O(1); each poll still costs O(watchers) in the
+ * kernel. poll() has no edge-triggered mode, EV_ET watchers are reported
+ * level-triggered. One-shot watchers are dropped from the array when they
+ * fire.
+ */
+
+// Backend-specific structure
+typedef struct ev_poll
+{
+    ev_backend_t base; // Must stay first, the loop only sees this part
+    struct pollfd *pfds; // Polled fds, dense
+    ev_io_t **watchers;  // Watcher of each pfds entry
+    int count;           // Entries used in pfds
+    int capacity;        // Entries allocated in pfds and watchers
+    int *slots;          // Index in pfds plus one by fd, 0 when not polled
+    int slot_capacity;   // Entries allocated in slots
+    int active_watcher_count;
+} ev_poll_t;
+
+// Initialize backend
+static ev_backend_t *ev_poll_init(const ev_loop_options_t *options)
+{
+    (void)options;
+    ev_poll_t *backend = (ev_poll_t *)calloc(1, sizeof(ev_poll_t));
+    if (!backend)
+        return NULL;
+
+    return &backend->base;
+}
+
+// Destroy backend
+static void ev_poll_destroy(ev_backend_t *base)
+{
+    ev_poll_t *backend = (ev_poll_t *)base;
+    if (!backend)
+        return;
+
+    free(backend->pfds);
+    free(backend->watchers);
+    free(backend->slots);
+    free(backend);
+}
+
+// Prepare backend (queue pending tasks, etc.)
+static void ev_poll_prepare(ev_backend_t *base)
+{
+    (void)base;
+}
+
+static inline short ev_poll_mask(int events)
+{
+    return (events & EV_READ ? POLLIN : 0) | (events & EV_WRITE ? POLLOUT : 0);
+}
+
+// EV_READ / EV_WRITE side of reported events, errors and hangups wake both
+static inline int ev_poll_ready(int revents)
+{
+    return (revents & (POLLIN | POLLHUP | POLLERR) ? EV_READ : 0) |
+           (revents & (POLLOUT | POLLHUP | POLLERR) ? EV_WRITE : 0) | (revents & POLLERR ? EV_READY_ERROR : 0);
+}
+
+// Make sure fd has a slot in the slot table
+static int ev_poll_fd_reserve(ev_poll_t *backend, int fd)
+{
+    if (fd < backend->slot_capacity)
+        return 0;
+
+    int capacity = backend->slot_capacity ? backend->slot_capacity : 64;
+    while (capacity <= fd)
+        capacity *= 2;
+
+    int *slots = (int *)realloc(backend->slots, sizeof(int) * capacity);
+    if (!slots)
+    {
+        perror("Failed to grow poll fd table");
+        return -1;
+    }
+    memset(slots + backend->slot_capacity, 0, sizeof(int) * (capacity - backend->slot_capacity));
+
+    backend->slots = slots;
+    backend->slot_capacity = capacity;
+    return 0;
+}
+
+// Drop the pfds entry at `index`, the last entry moves into its place
+static void ev_poll_remove(ev_poll_t *backend, int index)
+{
+    int last = --backend->count;
+
+    backend->slots[backend->watchers[index]->fd] = 0;
+    if (index != last)
+    {
+        backend->pfds[index] = backend->pfds[last];
+        backend->watchers[index] = backend->watchers[last];
+        backend->slots[backend->watchers[index]->fd] = index + 1;
+    }
+    backend->active_watcher_count--;
+}
+
+// Poll backend for events
+static int ev_poll_poll(ev_backend_t *base, int timeout)
+{
+    ev_poll_t *backend = (ev_poll_t *)base;
+    return poll(backend->pfds, backend->count, timeout);
+}
+
+// Dispatch events: I/O watchers are queued on `pending`
+static void ev_poll_dispatch(ev_backend_t *base, int ready, ev_pending_queue_t *pending)
+{
+    ev_poll_t *backend = (ev_poll_t *)base;
+
+    // Backwards, removing an entry only moves one that was already looked at
+    for (int i = backend->count - 1; i >= 0 && ready > 0; i--)
+    {
+        struct pollfd *pfd = &backend->pfds[i];
+        if (!pfd->revents)
+            continue;
+        ready--;
+
+        ev_io_t *watcher = backend->watchers[i];
+        int revents = pfd->revents;
+
+        // Closed without being stopped, like epoll just never report it again
+        if (revents & POLLNVAL)
+        {
+            pfd->fd = -1;
+            continue;
+        }
+
+        if (watcher->events & EV_ONESHOT)
+        {
+            watcher->active = false;
+            ev_poll_remove(backend, i);
+        }
+
+        ev_pending_feed(pending, watcher, revents, ev_poll_ready(revents));
+    }
+}
+
+// Check if backend has pending tasks
+static int ev_poll_is_empty(ev_backend_t *base)
+{
+    ev_poll_t *backend = (ev_poll_t *)base;
+    return backend->active_watcher_count == 0;
+}
+
+static int ev_poll_active_count(ev_backend_t *base)
+{
+    ev_poll_t *backend = (ev_poll_t *)base;
+    return backend->active_watcher_count;
+}
+
+// Register I/O event
+static void ev_poll_register_io(ev_backend_t *base, ev_io_t *watcher)
+{
+    ev_poll_t *backend = (ev_poll_t *)base;
+    if (!backend || !watcher)
+        return;
+
+    if (ev_poll_fd_reserve(backend, watcher->fd) != 0)
+    {
+        watcher->active = false;
+        return;
+    }
+
+    if (backend->slots[watcher->fd])
+    {
+        fprintf(stderr, "fd %d already has an active watcher\n", watcher->fd);
+        watcher->active = false;
+        return;
+    }
+
+    if (backend->count == backend->capacity)
+    {
+        int capacity = backend->capacity ? backend->capacity * 2 : 16;
+        struct pollfd *pfds = (struct pollfd *)realloc(backend->pfds, sizeof(struct pollfd) * capacity);
+        if (pfds)
+            backend->pfds = pfds;
+        ev_io_t **watchers = (ev_io_t **)realloc(backend->watchers, sizeof(ev_io_t *) * capacity);
+        if (watchers)
+            backend->watchers = watchers;
+        if (!pfds || !watchers)
+        {
+            perror("Failed to grow poll set");
+            watcher->active = false;
+            return;
+        }
+        backend->capacity = capacity;
+    }
+
+    int index = backend->count++;
+    backend->pfds[index].fd = watcher->fd;
+    backend->pfds[index].events = ev_poll_mask(watcher->events);
+    backend->pfds[index].revents = 0;
+    backend->watchers[index] = watcher;
+    backend->slots[watcher->fd] = index + 1;
+    backend->active_watcher_count++;
+}
+
+static void ev_poll_unregister_io(ev_backend_t *base, ev_io_t *watcher)
+{
+    ev_poll_t *backend = (ev_poll_t *)base;
+    if (!backend || !watcher || watcher->fd >= backend->slot_capacity)
+        return;
+
+    int slot = backend->slots[watcher->fd];
+    if (!slot || backend->watchers[slot - 1] != watcher)
+        return;
+
+    ev_poll_remove(backend, slot - 1);
+}
+
+// Change an active watcher's interest, used by the next poll
+static void ev_poll_modify_io(ev_backend_t *base, ev_io_t *watcher, int events)
+{
+    ev_poll_t *backend = (ev_poll_t *)base;
+    watcher->events = events;
+
+    int slot = watcher->fd < backend->slot_capacity ? backend->slots[watcher->fd] : 0;
+    if (slot && backend->watchers[slot - 1] == watcher)
+    {
+        backend->pfds[slot - 1].events = ev_poll_mask(events);
+    }
+}
+
+// No native completion API, the loop emulates requests on top of readiness
+static int ev_poll_submit(ev_backend_t *base, ev_req_t *req)
+{
+    (void)base;
+    (void)req;
+    return -ENOSYS;
+}
+
+// Buffers are handed out by the loop on readiness, nothing to register
+static int ev_poll_buf_pool_register(ev_backend_t *base, ev_buf_pool_t *pool)
+{
+    (void)base;
+    (void)pool;
+    return -ENOSYS;
+}
+
+static void ev_poll_buf_pool_unregister(ev_backend_t *base, ev_buf_pool_t *pool)
+{
+    (void)base;
+    (void)pool;
+}
+
+static void ev_poll_buf_pool_recycle(ev_backend_t *base, ev_buf_pool_t *pool, unsigned id)
+{
+    (void)base;
+    (void)pool;
+    (void)id;
+}
+
+// No way to post into another loop's queue, the loop writes its wakeup fd
+static int ev_poll_notify(ev_backend_t *base, ev_backend_t *target_base, ev_io_t *watcher)
+{
+    (void)base;
+    (void)target_base;
+    (void)watcher;
+    return -ENOSYS;
+}
+
+// Signals need a signalfd (Linux) or kqueue
+static int ev_poll_signal(ev_backend_t *base, int signum, bool enable, ev_io_t *watcher)
+{
+    (void)base;
+    (void)signum;
+    (void)enable;
+    (void)watcher;
+    return -ENOSYS;
+}
+
+static const ev_backend_ops_t ev_poll_ops = {
+    "poll",
+    EV_BACKEND_POLL,
+    ev_poll_init,
+    ev_poll_destroy,
+    ev_poll_prepare,
+    ev_poll_poll,
+    ev_poll_dispatch,
+    ev_poll_is_empty,
+    ev_poll_active_count,
+    ev_poll_register_io,
+    ev_poll_unregister_io,
+    ev_poll_modify_io,
+    ev_poll_submit,
+    ev_poll_buf_pool_register,
+    ev_poll_buf_pool_unregister,
+    ev_poll_buf_pool_recycle,
+    ev_poll_notify,
+    ev_poll_signal,
+};
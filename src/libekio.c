@@ -1,14 +1,33 @@
 #include "../config.h"
+#if HAVE_LINUX && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // pthread_setaffinity_np, cpu_set_t
+#endif
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include <time.h>
 #include "libekio.h"
 #include <fcntl.h>
 #include <signal.h>
+#include <pthread.h>
 #include <sys/time.h>
 
+// Loop clock, metrics and watchdog, used from the pending queue on
+#include "core/stats.c"
+#include "core/watchdog.c"
+#include "core/timer.c"
+
+// Backends queue ready I/O watchers here instead of calling them
+#include "core/hooks.c"
+#include "core/slab.c"
+#include "core/fd.c"
+#include "core/pending.c"
+
+// Every backend available on the platform is built in, loops pick one at runtime
+#include "event_notification/backend.c"
+
 #if HAVE_KQUEUE
 #include "event_notification/kqueue.c"
 #endif
@@ -21,49 +40,219 @@
 #include "event_notification/io_uring.c"
 #endif
 
+#include "event_notification/poll.c"
+
+#include "core/buffer.c"
+#include "core/request.c"
+#include "core/async.c"
+#include "core/thread_pool.c"
+#include "core/signal.c"
+#include "core/runtime.c"
+
 // Event loop structure
 struct ev_loop
 {
-    ev_backend_t *backend;  // Backend-specific operations
-    unsigned int iteration; // Current iteration count
-    unsigned int depth;     // Recursion depth
-    bool running;           // Is the loop running
-    int break_status;       // EVBREAK_*
+    ev_backend_t *backend;     // Backend-specific operations
+    ev_loop_options_t options; // Options the loop was created with
+    ev_timer_heap_t timers;    // Active timers ordered by expiry
+    ev_req_queue_t completed;  // Emulated requests done without waiting
+    ev_pending_queue_t pending; // Ready I/O watchers by priority
+    ev_wake_t wake;            // Wakeup fd other threads signal
+    ev_task_queue_t tasks;     // Tasks posted from any thread
+    ev_hook_list_t asyncs;     // Started async watchers
+    ev_hook_list_t prepares;   // Called before every poll
+    ev_hook_list_t checks;     // Called at the end of every iteration
+    ev_hook_list_t idles;      // Called when an iteration found nothing to do
+    ev_hook_list_t forks;      // Called in the child after ev_loop_fork
+    ev_fd_table_t fds;         // Started I/O watchers by fd
+    bool postfork;             // ev_loop_fork ran, fork watchers are due
+    int work_queue;            // Thread pool queue this loop submits to, -1 before first use
+    int work_pending;          // Thread pool items whose done callback hasn't run
+    ev_signal_set_t signals;   // Signal watchers by signal number
+    int internal_ios;          // Active I/O watchers owned by the loop itself
+    double now;                // Monotonic time sampled once per iteration, see ev_now
+    ev_probe_t probe;          // Metrics (options.stats) and watchdog heartbeat around callbacks
+    ev_watchdog_t *watchdog;   // Set by ev_loop_set_watchdog
+    ev_pool_t *pool;           // ev_loop_pool, NULL until first used
+    unsigned int iteration;    // Current iteration count
+    unsigned int depth;        // Recursion depth
+    bool running;              // Is the loop running
+    int break_status;          // EVBREAK_*
 };
 
-// Default event loop
+static void ev_loop_wake_cb(ev_io_t *watcher, int revents);
+static void ev_loop_signal_cb(ev_io_t *watcher, int revents);
+static void ev_loop_start_internal(ev_loop_t *loop, ev_io_t *watcher);
+static void ev_loop_stop_internal(ev_loop_t *loop, ev_io_t *watcher);
+static void ev_loop_run_prepares(ev_loop_t *loop);
+static void ev_loop_run_checks(ev_loop_t *loop);
+static void ev_loop_run_idles(ev_loop_t *loop);
+static void ev_loop_run_forks(ev_loop_t *loop);
+static void ev_loop_stats_iteration(ev_loop_t *loop, int called, int fired);
+
+// Default event loop, shared by the process
 static ev_loop_t *default_loop = NULL;
+static pthread_mutex_t default_loop_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Loop inside ev_run on this thread
+static __thread ev_loop_t *current_loop = NULL;
 
 // initialize a default loop
 struct ev_loop *ev_default_loop()
 {
-    if (!default_loop)
+    ev_loop_t *loop = __atomic_load_n(&default_loop, __ATOMIC_ACQUIRE);
+    if (loop)
+        return loop;
+
+    // Threads may race on first use, only one of them creates the loop
+    pthread_mutex_lock(&default_loop_lock);
+    loop = default_loop;
+    if (!loop)
     {
-        default_loop = ev_loop_create();
+        loop = ev_loop_create();
+        __atomic_store_n(&default_loop, loop, __ATOMIC_RELEASE);
     }
-    return default_loop;
+    pthread_mutex_unlock(&default_loop_lock);
+    return loop;
+}
+
+struct ev_loop *ev_current_loop()
+{
+    return current_loop;
+}
+
+// fill loop options with defaults
+void ev_loop_options_init(ev_loop_options_t *options)
+{
+    options->max_events = EV_DEFAULT_MAX_EVENTS;
+    options->max_events_cap = EV_DEFAULT_MAX_EVENTS_CAP;
+    options->work_queue_depth = 0;
+    options->work_max_wait = 0;
+    options->backends = 0;
+    options->stats = 0;
+    options->pool = 0;
 }
 
 // create a new loop
 struct ev_loop *ev_loop_create()
+{
+    return ev_loop_create_with_options(NULL);
+}
+
+// create a new loop on the best of the given EV_BACKEND_* kinds
+struct ev_loop *ev_loop_create_with(int backends)
+{
+    ev_loop_options_t options;
+    ev_loop_options_init(&options);
+    options.backends = backends;
+    return ev_loop_create_with_options(&options);
+}
+
+// create a new loop with explicit options (NULL for defaults)
+struct ev_loop *ev_loop_create_with_options(const ev_loop_options_t *options)
 {
     ev_loop_t *loop = (ev_loop_t *)malloc(sizeof(ev_loop_t));
     if (!loop)
         return NULL;
 
+    if (options)
+        loop->options = *options;
+    else
+        ev_loop_options_init(&loop->options);
+
+    if (loop->options.max_events <= 0)
+        loop->options.max_events = EV_DEFAULT_MAX_EVENTS;
+    if (loop->options.max_events_cap < loop->options.max_events)
+        loop->options.max_events_cap = loop->options.max_events;
+
+    loop->probe.stats = NULL;
+    loop->probe.heartbeat = NULL;
+    loop->watchdog = NULL;
+    loop->pool = NULL;
+
     // Backend initialization
-    loop->backend = ev_backend_init();
+    loop->backend = ev_backend_init(&loop->options);
     if (!loop->backend)
     {
         free(loop);
         return NULL;
     }
+    // A forked child rebuilds the loop on the same kind
+    loop->options.backends = ev_backend_kind(loop->backend);
+    loop->now = ev_time();
+
+    if (ev_timer_heap_init(&loop->timers) != 0)
+    {
+        ev_backend_destroy(loop->backend);
+        free(loop);
+        return NULL;
+    }
+
+    ev_req_queue_init(&loop->completed);
+    ev_fd_table_init(&loop->fds, loop->backend);
+    ev_pending_queue_init(&loop->pending, &loop->fds);
+    ev_task_queue_init(&loop->tasks);
+    ev_hook_list_init(&loop->asyncs);
+    ev_hook_list_init(&loop->prepares);
+    ev_hook_list_init(&loop->checks);
+    ev_hook_list_init(&loop->idles);
+    ev_hook_list_init(&loop->forks);
+    loop->postfork = false;
+    loop->work_queue = -1;
+    loop->work_pending = 0;
+    loop->internal_ios = 0;
+    ev_signal_set_init(&loop->signals);
+
+    if (ev_wake_init(&loop->wake) != 0)
+    {
+        ev_timer_heap_destroy(&loop->timers);
+        ev_backend_destroy(loop->backend);
+        free(loop);
+        return NULL;
+    }
+
+    ev_io_init(&loop->wake.watcher, ev_loop_wake_cb, loop->wake.fds[0], EV_READ);
+    loop->wake.watcher.data = loop;
+    ev_loop_start_internal(loop, &loop->wake.watcher);
+
+    // Started with the first signal watcher, the fd is filled in then
+    loop->signals.watcher.type = IO_EVENT;
+    loop->signals.watcher.fd = -1;
+    loop->signals.watcher.events = EV_READ;
+    loop->signals.watcher.callback = ev_loop_signal_cb;
+    loop->signals.watcher.data = loop;
+    loop->signals.watcher.active = false;
+    loop->signals.watcher.priority = 0;
+    loop->signals.watcher.pending = 0;
+    loop->signals.watcher.next_fd = NULL;
 
     loop->iteration = 0;
     loop->depth = 0;
     loop->running = false;
     loop->break_status = EVBREAK_NONE;
 
+    // Shared fd registrations come and go with connections, keep them off malloc
+    if (loop->options.pool)
+    {
+        if (!ev_loop_pool(loop))
+        {
+            ev_loop_destroy(loop);
+            return NULL;
+        }
+        loop->fds.pool = loop->pool;
+    }
+
+    if (loop->options.stats)
+    {
+        loop->probe.stats = (ev_loop_stats_t *)calloc(1, sizeof(ev_loop_stats_t));
+        if (!loop->probe.stats)
+        {
+            perror("Failed to allocate loop stats");
+            ev_loop_destroy(loop);
+            return NULL;
+        }
+    }
+
     return loop;
 };
 
@@ -73,16 +262,64 @@ void ev_loop_destroy(struct ev_loop *loop)
     if (!loop)
         return;
 
+    ev_watchdog_destroy(loop->watchdog);
+    ev_loop_stop_internal(loop, &loop->wake.watcher);
+    ev_wake_destroy(&loop->wake);
+    ev_loop_stop_internal(loop, &loop->signals.watcher);
+    ev_signal_set_destroy(&loop->signals, loop, loop->backend);
+    ev_hook_list_destroy(&loop->asyncs);
+    ev_hook_list_destroy(&loop->prepares);
+    ev_hook_list_destroy(&loop->checks);
+    ev_hook_list_destroy(&loop->idles);
+    ev_hook_list_destroy(&loop->forks);
+
     // Destroy backend-specific data
     ev_backend_destroy(loop->backend);
+    ev_pending_queue_destroy(&loop->pending);
+    ev_fd_table_destroy(&loop->fds);
+    if (loop->pool)
+        ev_slab_pool_destroy(loop->pool);
+    ev_timer_heap_destroy(&loop->timers);
+    free(loop->probe.stats);
 
-    free(loop);
+    pthread_mutex_lock(&default_loop_lock);
     if (loop == default_loop)
     {
-        default_loop = NULL;
+        __atomic_store_n(&default_loop, NULL, __ATOMIC_RELEASE);
     }
+    pthread_mutex_unlock(&default_loop_lock);
+
+    free(loop);
 };
 
+// loop has nothing left to wait for
+static int ev_loop_is_empty(struct ev_loop *loop)
+{
+    int watchers = ev_backend_active_count(loop->backend) - loop->internal_ios;
+    return watchers == 0 && loop->timers.count == 0 && loop->completed.count == 0 && loop->pending.count == 0 &&
+           loop->asyncs.count == 0 && loop->work_pending == 0 && loop->signals.count == 0 &&
+           loop->idles.count == 0;
+}
+
+// Start a watcher the loop owns itself, it doesn't keep the loop alive
+static void ev_loop_start_internal(ev_loop_t *loop, ev_io_t *watcher)
+{
+    if (watcher->active)
+        return;
+    // Wakeups and signals must not wait behind user traffic
+    watcher->priority = EV_MAXPRI;
+    ev_io_start(loop, watcher);
+    loop->internal_ios++;
+}
+
+static void ev_loop_stop_internal(ev_loop_t *loop, ev_io_t *watcher)
+{
+    if (!watcher->active)
+        return;
+    ev_io_stop(loop, watcher);
+    loop->internal_ios--;
+}
+
 // run the event loop
 int ev_run(struct ev_loop *loop, int flags)
 {
@@ -90,6 +327,14 @@ int ev_run(struct ev_loop *loop, int flags)
     if (!loop || !loop->backend)
         return 0;
 
+    ev_loop_t *outer_loop = current_loop;
+    current_loop = loop;
+
+    // The loop's pool may have been made on the thread that created the loop,
+    // from here on its callbacks allocate from it
+    if (loop->pool)
+        ev_slab_pool_bind(loop->pool);
+
     loop->depth++;
     loop->break_status = EVBREAK_NONE;
     loop->running = true;
@@ -99,16 +344,45 @@ int ev_run(struct ev_loop *loop, int flags)
     while (loop->running)
     {
         // printf("Loop started working");
-        //  Queue and call pending watchers (prepare, fork, etc.)
+        // First iteration in a forked child
+        if (loop->postfork)
+        {
+            loop->postfork = false;
+            ev_loop_run_forks(loop);
+        }
+
+        // Last chance to queue work (e.g. flush batched writes) before blocking
+        ev_loop_run_prepares(loop);
         ev_backend_prepare(loop->backend);
 
         if (loop->break_status != EVBREAK_NONE)
             break;
 
+        // Nothing could ever wake a blocking poll
+        if (ev_loop_is_empty(loop))
+            break;
+
         // printf("Getting new event using backend poll");
 
-        // Block and wait for events
-        int new_events = ev_backend_poll(loop->backend, flags);
+        // Block until the nearest timer (or forever without timers), only
+        // EVRUN_NOWAIT turns this into a non-blocking check
+        int timeout = (flags & EVRUN_NOWAIT) ? 0 : -1;
+        if (loop->completed.count > 0 || loop->pending.count > 0 || loop->idles.count > 0)
+            timeout = 0; // Completions or callbacks over budget are waiting, or idle work wants the CPU
+        if (timeout != 0)
+            ev_now_update(loop); // Callbacks since the last sample must not stretch the wait
+        double poll_start = (loop->probe.stats && timeout == 0) ? ev_time() : loop->now;
+        timeout = ev_timer_heap_timeout(&loop->timers, loop->now, timeout);
+        int new_events = ev_backend_poll(loop->backend, timeout);
+
+        // The one clock read of the iteration, callbacks and timers go by it
+        ev_now_update(loop);
+        if (loop->probe.stats && new_events >= 0)
+        {
+            ev_histogram_record(&loop->probe.stats->poll_wait, ev_stats_us(loop->now - poll_start));
+            ev_histogram_record(&loop->probe.stats->poll_events, new_events);
+            ev_stats_add(&loop->probe.stats->events, new_events);
+        }
 
         // printf("New Events %d Running %d\n", new_events, loop->running);
 
@@ -124,19 +398,37 @@ int ev_run(struct ev_loop *loop, int flags)
 
         // printf("Active Dount %d", loop->backend->active_watcher_count);
 
-        if (new_events == 0)
+        // printf("EV Backend Dispatch Event");
+        //  Handle new events
+        if (new_events > 0)
         {
-            continue;
+            ev_backend_dispatch(loop->backend, new_events, &loop->pending);
         }
 
-        // printf("EV Backend Dispatch Event");
-        //  Handle new events
-        ev_backend_dispatch(loop->backend);
+        // Call ready I/O watchers, highest priority first and within budgets
+        int called = ev_pending_run(&loop->pending, &loop->probe);
+
+        // Fire expired timers
+        int fired = ev_timer_heap_run(&loop->timers, loop->now, &loop->probe);
+
+        // Deliver requests that completed without waiting
+        int completed = loop->completed.count;
+        ev_req_queue_run(&loop->completed);
+
+        // Idle watchers only get iterations in which nothing else happened
+        if (new_events == 0 && called == 0 && fired == 0 && completed == 0)
+            ev_loop_run_idles(loop);
+
+        // Everything this iteration produced has run, e.g. flush per-socket batches
+        ev_loop_run_checks(loop);
+
+        if (loop->probe.stats)
+            ev_loop_stats_iteration(loop, called, fired);
 
         // Break if necessary
         if (loop->break_status == EVBREAK_ONE ||
             (flags & EVRUN_ONCE) ||
-            ev_backend_is_empty(loop->backend))
+            ev_loop_is_empty(loop))
         {
             break;
         }
@@ -151,7 +443,8 @@ int ev_run(struct ev_loop *loop, int flags)
     }
 
     loop->depth--;
-    return ev_backend_is_empty(loop->backend) ? 0 : 1;
+    current_loop = outer_loop;
+    return ev_loop_is_empty(loop) ? 0 : 1;
 }
 
 // Function to break the loop
@@ -174,16 +467,133 @@ unsigned int ev_depth(struct ev_loop *loop)
     return loop ? loop->depth : 0;
 }
 
+// Time of the current iteration, read after the poll returned
+double ev_now(struct ev_loop *loop)
+{
+    return loop->now;
+}
+
+// Sample the clock again, for callbacks that block or run for long
+void ev_now_update(struct ev_loop *loop)
+{
+    loop->now = ev_time();
+}
+
+// Copy the loop's metrics, callable from any thread while the loop runs
+int ev_loop_stats(struct ev_loop *loop, ev_loop_stats_t *stats)
+{
+    if (!loop || !loop->probe.stats)
+        return -1;
+
+    ev_stats_read(loop->probe.stats, stats);
+    return 0;
+}
+
+// Start, replace or (threshold_ms 0) stop the loop's slow-callback watchdog
+int ev_loop_set_watchdog(struct ev_loop *loop, int threshold_ms, ev_watchdog_cb hook, void *data)
+{
+    if (!loop)
+        return -1;
+
+    loop->probe.heartbeat = NULL;
+    ev_watchdog_destroy(loop->watchdog);
+    loop->watchdog = NULL;
+
+    if (threshold_ms <= 0)
+        return 0;
+    if (!hook)
+        return -1;
+
+    loop->watchdog = ev_watchdog_create(loop, &loop->iteration, threshold_ms, hook, data);
+    if (!loop->watchdog)
+        return -1;
+    loop->probe.heartbeat = &loop->watchdog->heartbeat;
+    return 0;
+}
+
+// Close an iteration's metrics, after the check watchers ran
+static void ev_loop_stats_iteration(ev_loop_t *loop, int called, int fired)
+{
+    ev_loop_stats_t *stats = loop->probe.stats;
+
+    ev_histogram_record(&stats->dispatch, ev_stats_us(ev_time() - loop->now));
+    ev_stats_add(&stats->iterations, 1);
+    ev_stats_add(&stats->callbacks, called);
+    ev_stats_add(&stats->timers_fired, fired);
+    ev_stats_set(&stats->active_ios, ev_backend_active_count(loop->backend) - loop->internal_ios);
+    ev_stats_set(&stats->active_timers, loop->timers.count);
+    ev_stats_set(&stats->pending, loop->pending.count);
+}
+
+// EV_BACKEND_* the loop runs on
+int ev_loop_backend(struct ev_loop *loop)
+{
+    return loop ? ev_backend_kind(loop->backend) : 0;
+}
+
+// Cap the I/O callbacks one priority gets per iteration, 0 removes the cap
+void ev_loop_set_budget(struct ev_loop *loop, int priority, int budget)
+{
+    if (!loop || priority < EV_MINPRI || priority > EV_MAXPRI)
+        return;
+    loop->pending.levels[priority - EV_MINPRI].budget = budget > 0 ? budget : 0;
+}
+
 void ev_suspend(struct ev_loop *loop)
 {
+    (void)loop;
     // Optionally implement backend-specific suspend logic
 }
 
 void ev_resume(struct ev_loop *loop)
 {
+    (void)loop;
     // Optionally implement backend-specific resume logic
 }
 
+// Rebuild the loop's kernel state in a forked child
+int ev_loop_fork(struct ev_loop *loop)
+{
+    if (!loop)
+        return -1;
+
+    // The inherited epoll set / ring / kqueue still belongs to the parent,
+    // dropping our copy leaves the parent's registrations alone
+    ev_backend_t *backend = ev_backend_init(&loop->options);
+    if (!backend)
+        return -1;
+    ev_backend_destroy(loop->backend);
+    loop->backend = backend;
+
+    // The new wakeup fd usually gets another number. Its watcher leaves the fd
+    // table under the old one, or the next fd opened with that number would be
+    // taken for the wakeup's, and joins it again under the new one
+    ev_fd_unlink(&loop->fds, &loop->wake.watcher);
+    if (ev_wake_fork(&loop->wake) != 0)
+        return -1;
+    loop->wake.watcher.fd = loop->wake.fds[0];
+
+    // Timers live in the loop itself, only I/O watchers need the kernel
+    ev_fd_table_rebuild(&loop->fds, backend);
+    ev_fd_start(&loop->fds, &loop->wake.watcher);
+    if (!loop->wake.watcher.active)
+        return -1;
+
+    if (ev_signal_set_fork(&loop->signals, backend) != 0)
+        return -1;
+
+    // Only the forking thread survives, the child needs a watchdog thread of its own
+    if (loop->watchdog && ev_watchdog_start(loop->watchdog) != 0)
+    {
+        free(loop->watchdog);
+        loop->watchdog = NULL;
+        loop->probe.heartbeat = NULL;
+    }
+
+    loop->postfork = true;
+    return 0;
+}
+
 /*****
  *
  *
@@ -217,6 +627,9 @@ void ev_io_init(ev_io_t *watcher, ev_io_cb callback, int fd, int events)
     watcher->callback = callback;
     watcher->active = false;
     watcher->data = NULL;
+    watcher->priority = 0;
+    watcher->pending = 0;
+    watcher->next_fd = NULL;
 
     ev_io_set(watcher, fd, events);
 }
@@ -235,7 +648,10 @@ void ev_io_set(ev_io_t *watcher, int fd, int events)
         perror("fcntl");
         return;
     }
-    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    if (!(flags & O_NONBLOCK))
+    {
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
 }
 
 // Start monitoring an I/O watcher
@@ -244,18 +660,54 @@ void ev_io_start(ev_loop_t *loop, ev_io_t *watcher)
     if (!watcher->active)
     {
         watcher->active = true;
-        ev_backend_register_io(loop->backend, watcher);
+        ev_fd_start(&loop->fds, watcher);
     }
 }
 
+// Set the priority of a stopped I/O watcher, clamped to EV_MINPRI..EV_MAXPRI
+void ev_io_set_priority(ev_io_t *watcher, int priority)
+{
+    // The pending queue finds a watcher by its priority
+    if (watcher->active || watcher->pending)
+        return;
+
+    if (priority < EV_MINPRI)
+        priority = EV_MINPRI;
+    if (priority > EV_MAXPRI)
+        priority = EV_MAXPRI;
+    watcher->priority = priority;
+}
+
 // Stop monitoring an I/O watcher
 void ev_io_stop(ev_loop_t *loop, ev_io_t *watcher)
 {
+    ev_pending_clear(&loop->pending, watcher);
+
     if (watcher->active)
     {
         watcher->active = false;
-        ev_backend_unregister_io(loop->backend, watcher);
+        ev_fd_stop(&loop->fds, watcher);
+    }
+    else
+    {
+        // A one-shot watcher is already inactive while its callback is queued
+        ev_fd_unlink(&loop->fds, watcher);
+    }
+}
+
+// Change the events of an I/O watcher without stopping it
+void ev_io_modify(ev_loop_t *loop, ev_io_t *watcher, int events)
+{
+    if (watcher->events == events)
+        return;
+
+    if (!watcher->active)
+    {
+        watcher->events = events;
+        return;
     }
+
+    ev_fd_modify(&loop->fds, watcher, events);
 }
 
 // Handle SIGPIPE for pipe/socket writing errors
@@ -299,7 +751,7 @@ void ev_io_setup_sigpipe_handling()
  *
  *
  */
-static uintptr_t timer_id_counter = 0; // To generate unique timer IDs
+static uintptr_t timer_id_counter = 0; // To generate unique timer IDs, shared by all threads
 
 void ev_timer_init(ev_timer_t *timer, ev_timer_cb callback, double after, double repeat)
 {
@@ -309,8 +761,11 @@ void ev_timer_init(ev_timer_t *timer, ev_timer_cb callback, double after, double
     timer->callback = callback;
     timer->data = NULL;
     timer->active = 0;
-    timer->ident = ++timer_id_counter;
+    timer->ident = __atomic_add_fetch(&timer_id_counter, 1, __ATOMIC_RELAXED);
     timer->type = TIMER_EVENT;
+    timer->at = 0;
+    timer->expires = 0;
+    timer->heap_index = -1;
     // printf("Timer Completed\n");
 }
 
@@ -326,16 +781,11 @@ void ev_timer_start(ev_loop_t *loop, ev_timer_t *timer)
     if (timer->active)
         return; // Prevent duplicate starts
 
-    ev_backend_t *backend = (ev_backend_t *)loop->backend;
-
-    int backend_register = ev_backend_register_timer(backend, timer);
-
-    // printf("Backend Register %d\n", backend_register);
-
-    // Register the timer with the backend
-    if (backend_register != 0)
+    // Queue the timer in the loop's heap, no kernel object is involved
+    timer->at = timer->expires = loop->now + timer->after;
+    if (ev_timer_heap_push(&loop->timers, timer) != 0)
     {
-        fprintf(stderr, "Failed to register timer with backend\n");
+        fprintf(stderr, "Failed to register timer with loop\n");
         return;
     }
 
@@ -348,13 +798,7 @@ void ev_timer_stop(ev_loop_t *loop, ev_timer_t *timer)
     if (!timer->active)
         return;
 
-    ev_backend_t *backend = (ev_backend_t *)loop->backend;
-
-    if (ev_backend_unregister_timer(backend, timer) != 0)
-    {
-        fprintf(stderr, "Failed to unregister timer from backend\n");
-        return;
-    }
+    ev_timer_heap_remove(&loop->timers, timer);
     timer->active = false;
 }
 
@@ -363,11 +807,718 @@ void ev_timer_again(ev_loop_t *loop, ev_timer_t *timer)
     if (timer->repeat > 0)
     {
         ev_timer_set(timer, timer->repeat, timer->repeat);
-        ev_timer_stop(loop, timer);
-        ev_timer_start(loop, timer);
+        if (timer->active)
+        {
+            // Lazy re-arm: the heap is only fixed up if the old deadline fires first
+            ev_timer_heap_rearm(&loop->timers, timer, loop->now + timer->repeat);
+        }
+        else
+        {
+            ev_timer_start(loop, timer);
+        }
     }
     else
     {
         fprintf(stderr, "Cannot restart a non-repeating timer\n");
     }
 }
+
+/*****
+ *
+ *
+ *
+ *
+ *
+ * Prepare / Check / Idle Realated Implementation
+ *
+ *
+ *
+ *
+ *
+ */
+
+static void ev_loop_run_prepares(ev_loop_t *loop)
+{
+    for (int i = ev_hook_list_begin(&loop->prepares); i >= 0; i--)
+    {
+        ev_prepare_t *watcher = (ev_prepare_t *)ev_hook_list_at(&loop->prepares, i);
+        if (watcher)
+            watcher->callback(watcher, 0);
+    }
+    ev_hook_list_end(&loop->prepares);
+}
+
+static void ev_loop_run_checks(ev_loop_t *loop)
+{
+    for (int i = ev_hook_list_begin(&loop->checks); i >= 0; i--)
+    {
+        ev_check_t *watcher = (ev_check_t *)ev_hook_list_at(&loop->checks, i);
+        if (watcher)
+            watcher->callback(watcher, 0);
+    }
+    ev_hook_list_end(&loop->checks);
+}
+
+static void ev_loop_run_idles(ev_loop_t *loop)
+{
+    for (int i = ev_hook_list_begin(&loop->idles); i >= 0; i--)
+    {
+        ev_idle_t *watcher = (ev_idle_t *)ev_hook_list_at(&loop->idles, i);
+        if (watcher)
+            watcher->callback(watcher, 0);
+    }
+    ev_hook_list_end(&loop->idles);
+}
+
+void ev_prepare_init(ev_prepare_t *watcher, ev_prepare_cb callback)
+{
+    watcher->type = PREPARE_EVENT;
+    watcher->callback = callback;
+    watcher->data = NULL;
+    watcher->active = false;
+    watcher->index = -1;
+}
+
+void ev_prepare_start(ev_loop_t *loop, ev_prepare_t *watcher)
+{
+    if (!watcher->active && ev_hook_list_add(&loop->prepares, watcher, &watcher->index) == 0)
+        watcher->active = true;
+}
+
+void ev_prepare_stop(ev_loop_t *loop, ev_prepare_t *watcher)
+{
+    if (!watcher->active)
+        return;
+    ev_hook_list_remove(&loop->prepares, &watcher->index);
+    watcher->active = false;
+}
+
+void ev_check_init(ev_check_t *watcher, ev_check_cb callback)
+{
+    watcher->type = CHECK_EVENT;
+    watcher->callback = callback;
+    watcher->data = NULL;
+    watcher->active = false;
+    watcher->index = -1;
+}
+
+void ev_check_start(ev_loop_t *loop, ev_check_t *watcher)
+{
+    if (!watcher->active && ev_hook_list_add(&loop->checks, watcher, &watcher->index) == 0)
+        watcher->active = true;
+}
+
+void ev_check_stop(ev_loop_t *loop, ev_check_t *watcher)
+{
+    if (!watcher->active)
+        return;
+    ev_hook_list_remove(&loop->checks, &watcher->index);
+    watcher->active = false;
+}
+
+void ev_idle_init(ev_idle_t *watcher, ev_idle_cb callback)
+{
+    watcher->type = IDLE_EVENT;
+    watcher->callback = callback;
+    watcher->data = NULL;
+    watcher->active = false;
+    watcher->index = -1;
+}
+
+void ev_idle_start(ev_loop_t *loop, ev_idle_t *watcher)
+{
+    if (!watcher->active && ev_hook_list_add(&loop->idles, watcher, &watcher->index) == 0)
+        watcher->active = true;
+}
+
+void ev_idle_stop(ev_loop_t *loop, ev_idle_t *watcher)
+{
+    if (!watcher->active)
+        return;
+    ev_hook_list_remove(&loop->idles, &watcher->index);
+    watcher->active = false;
+}
+
+static void ev_loop_run_forks(ev_loop_t *loop)
+{
+    for (int i = ev_hook_list_begin(&loop->forks); i >= 0; i--)
+    {
+        ev_fork_t *watcher = (ev_fork_t *)ev_hook_list_at(&loop->forks, i);
+        if (watcher)
+            watcher->callback(watcher, 0);
+    }
+    ev_hook_list_end(&loop->forks);
+}
+
+void ev_fork_init(ev_fork_t *watcher, ev_fork_cb callback)
+{
+    watcher->type = FORK_EVENT;
+    watcher->callback = callback;
+    watcher->data = NULL;
+    watcher->active = false;
+    watcher->index = -1;
+}
+
+void ev_fork_start(ev_loop_t *loop, ev_fork_t *watcher)
+{
+    if (!watcher->active && ev_hook_list_add(&loop->forks, watcher, &watcher->index) == 0)
+        watcher->active = true;
+}
+
+void ev_fork_stop(ev_loop_t *loop, ev_fork_t *watcher)
+{
+    if (!watcher->active)
+        return;
+    ev_hook_list_remove(&loop->forks, &watcher->index);
+    watcher->active = false;
+}
+
+/*****
+ *
+ *
+ *
+ *
+ *
+ * Signal Realated Implementation
+ *
+ *
+ *
+ *
+ *
+ */
+
+#if EV_HAVE_SIGNALFD
+// The signalfd became readable
+static void ev_loop_signal_cb(ev_io_t *watcher, int revents)
+{
+    (void)revents;
+    ev_loop_t *loop = (ev_loop_t *)watcher->data;
+    ev_signal_set_read(&loop->signals);
+}
+#else
+// The backend reports one signal at a time, already coalesced
+static void ev_loop_signal_cb(ev_io_t *watcher, int signum)
+{
+    ev_loop_t *loop = (ev_loop_t *)watcher->data;
+    ev_signal_set_dispatch(&loop->signals, signum);
+}
+#endif
+
+void ev_signal_init(ev_signal_t *watcher, ev_signal_cb callback, int signum)
+{
+    watcher->type = SIGNAL_EVENT;
+    watcher->signum = signum;
+    watcher->callback = callback;
+    watcher->data = NULL;
+    watcher->active = false;
+    watcher->next = NULL;
+}
+
+void ev_signal_start(ev_loop_t *loop, ev_signal_t *watcher)
+{
+    if (watcher->active)
+        return;
+
+    int signum = watcher->signum;
+    if (signum <= 0 || signum >= NSIG)
+    {
+        fprintf(stderr, "Invalid signal %d\n", signum);
+        return;
+    }
+
+    if (!ev_signal_claim(loop, signum))
+    {
+        fprintf(stderr, "Signal %d is already watched by another loop\n", signum);
+        return;
+    }
+
+    // First watcher of this signal, start routing it to the loop
+    if (!loop->signals.heads[signum])
+    {
+        if (ev_signal_set_route(&loop->signals, loop->backend, signum, true) != 0)
+        {
+            ev_signal_release(loop, signum);
+            return;
+        }
+#if EV_HAVE_SIGNALFD
+        loop->signals.watcher.fd = loop->signals.fd;
+        ev_loop_start_internal(loop, &loop->signals.watcher);
+#endif
+    }
+
+    watcher->next = loop->signals.heads[signum];
+    loop->signals.heads[signum] = watcher;
+    loop->signals.count++;
+    watcher->active = true;
+}
+
+void ev_signal_stop(ev_loop_t *loop, ev_signal_t *watcher)
+{
+    if (!watcher->active)
+        return;
+
+    int signum = watcher->signum;
+    ev_signal_t **link = &loop->signals.heads[signum];
+    while (*link != watcher)
+        link = &(*link)->next;
+    *link = watcher->next;
+
+    watcher->next = NULL;
+    watcher->active = false;
+    loop->signals.count--;
+
+    // Last watcher gone, hand the signal back to how it was handled before
+    if (!loop->signals.heads[signum])
+    {
+        ev_signal_set_route(&loop->signals, loop->backend, signum, false);
+        ev_signal_release(loop, signum);
+    }
+}
+
+/*****
+ *
+ *
+ *
+ *
+ *
+ * Cross Thread Realated Implementation
+ *
+ *
+ *
+ *
+ *
+ */
+
+// Wake the loop unless a wakeup is already pending, async-signal-safe
+static void ev_loop_wake(ev_loop_t *loop)
+{
+    if (ev_wake_claim(&loop->wake))
+        ev_wake_signal(&loop->wake);
+}
+
+// Runs on the loop thread whenever another thread woke it
+static void ev_loop_wake_cb(ev_io_t *watcher, int revents)
+{
+    ev_loop_t *loop = (ev_loop_t *)watcher->data;
+
+    // A ring message (revents 0) wakes us without writing to the fd
+    ev_wake_consume(&loop->wake, revents != 0);
+
+    ev_task_t *task = ev_task_queue_take(&loop->tasks);
+    while (task)
+    {
+        ev_task_t *next = task->next; // fn may free or re-post the task
+        task->fn(task->data);
+        task = next;
+    }
+
+    for (int i = ev_hook_list_begin(&loop->asyncs); i >= 0; i--)
+    {
+        ev_async_t *async = (ev_async_t *)ev_hook_list_at(&loop->asyncs, i);
+        if (async && __atomic_exchange_n(&async->pending, 0, __ATOMIC_SEQ_CST))
+            async->callback(async, 0);
+    }
+    ev_hook_list_end(&loop->asyncs);
+}
+
+void ev_async_init(ev_async_t *watcher, ev_async_cb callback)
+{
+    watcher->type = ASYNC_EVENT;
+    watcher->callback = callback;
+    watcher->data = NULL;
+    watcher->active = false;
+    watcher->pending = 0;
+    watcher->index = -1;
+}
+
+void ev_async_start(ev_loop_t *loop, ev_async_t *watcher)
+{
+    if (watcher->active || ev_hook_list_add(&loop->asyncs, watcher, &watcher->index) != 0)
+        return;
+    watcher->active = true;
+
+    // Sent before it was started, make sure the loop looks at it
+    if (__atomic_load_n(&watcher->pending, __ATOMIC_SEQ_CST))
+        ev_loop_wake(loop);
+}
+
+void ev_async_stop(ev_loop_t *loop, ev_async_t *watcher)
+{
+    if (!watcher->active)
+        return;
+
+    ev_hook_list_remove(&loop->asyncs, &watcher->index);
+    watcher->active = false;
+}
+
+// Safe from any thread and from signal handlers
+void ev_async_send(ev_loop_t *loop, ev_async_t *watcher)
+{
+    ev_wake_enter(&loop->wake);
+    if (!__atomic_exchange_n(&watcher->pending, 1, __ATOMIC_SEQ_CST))
+        ev_loop_wake(loop); // Otherwise already on its way
+    ev_wake_leave(&loop->wake);
+}
+
+bool ev_async_pending(ev_async_t *watcher)
+{
+    return __atomic_load_n(&watcher->pending, __ATOMIC_SEQ_CST) != 0;
+}
+
+void ev_task_init(ev_task_t *task, ev_task_fn fn, void *data)
+{
+    task->fn = fn;
+    task->data = data;
+    task->next = NULL;
+}
+
+// Safe from any thread
+void ev_loop_post(ev_loop_t *loop, ev_task_t *task)
+{
+    ev_wake_enter(&loop->wake);
+    ev_task_queue_push(&loop->tasks, task);
+
+    // From another loop's thread, let its backend deliver the wakeup if it
+    // can (a ring-to-ring message on io_uring), otherwise write the fd
+    if (ev_wake_claim(&loop->wake))
+    {
+        if (!current_loop || current_loop == loop ||
+            ev_backend_notify(current_loop->backend, loop->backend, &loop->wake.watcher) != 0)
+            ev_wake_signal(&loop->wake);
+    }
+    ev_wake_leave(&loop->wake);
+}
+
+/*****
+ *
+ *
+ *
+ *
+ *
+ * Thread Pool Realated Implementation
+ *
+ *
+ *
+ *
+ *
+ */
+
+// Posted back by the worker, runs on the loop thread
+static void ev_work_done_task(void *data)
+{
+    ev_work_t *work = (ev_work_t *)data;
+
+    work->loop->work_pending--;
+    work->active = false;
+    if (work->done)
+        work->done(work, work->status);
+}
+
+int ev_work_submit(ev_loop_t *loop, ev_work_t *work, ev_work_fn work_fn, ev_work_done_cb done_cb)
+{
+    if (!loop || !work || !work_fn)
+        return -EINVAL;
+    if (work->active)
+        return -EBUSY;
+    if (loop->options.work_queue_depth > 0 && loop->work_pending >= loop->options.work_queue_depth)
+        return -EAGAIN;
+
+    ev_thread_pool_t *pool = ev_thread_pool_get();
+    if (!pool)
+        return -ENOMEM;
+
+    // Stick to one queue so this loop's work stays on one worker when it can
+    if (loop->work_queue < 0)
+        loop->work_queue = (int)(__atomic_fetch_add(&pool->next_queue, 1, __ATOMIC_RELAXED) % pool->count);
+
+    work->type = WORK_EVENT;
+    work->work = work_fn;
+    work->done = done_cb;
+    work->loop = loop;
+    work->status = 0;
+    work->deadline = loop->options.work_max_wait > 0 ? loop->now + loop->options.work_max_wait * 1e-3 : 0;
+    work->active = true;
+    ev_task_init(&work->task, ev_work_done_task, work);
+
+    loop->work_pending++;
+    ev_thread_pool_push(pool, loop->work_queue, work);
+    return 0;
+}
+
+/*****
+ *
+ *
+ *
+ *
+ *
+ * Async Request Realated Implementation
+ *
+ *
+ *
+ *
+ *
+ */
+
+void ev_req_init(ev_req_t *req)
+{
+    memset(req, 0, sizeof(ev_req_t));
+    req->type = REQ_EVENT;
+    req->fd = -1;
+}
+
+// Set up a request for its next operation, -EBUSY (leaving it untouched)
+// while it is still in flight
+static int ev_req_prepare(ev_req_t *req, int op, int fd, ev_req_cb callback)
+{
+    if (req->active)
+        return -EBUSY;
+
+    req->type = REQ_EVENT;
+    req->op = op;
+    req->fd = fd;
+    req->callback = callback;
+    req->next = NULL;
+    req->result = 0;
+    req->zc_notify = false;
+    return 0;
+}
+
+// Hand a prepared request to the backend, or emulate it on readiness backends
+static int ev_req_submit(ev_loop_t *loop, ev_req_t *req)
+{
+    req->loop = loop;
+    req->active = true;
+
+    int ret = ev_backend_submit(loop->backend, req);
+    if (ret == -ENOSYS)
+    {
+        ev_req_emulate(loop, &loop->completed, req);
+        return 0;
+    }
+
+    if (ret < 0)
+        req->active = false;
+    return ret;
+}
+
+int ev_read_async(ev_loop_t *loop, ev_req_t *req, int fd, void *buf, size_t len, ev_req_cb callback)
+{
+    if (ev_req_prepare(req, EV_OP_READ, fd, callback) != 0)
+        return -EBUSY;
+    req->buf = buf;
+    req->len = len;
+    return ev_req_submit(loop, req);
+}
+
+int ev_write_async(ev_loop_t *loop, ev_req_t *req, int fd, const void *buf, size_t len, ev_req_cb callback)
+{
+    if (ev_req_prepare(req, EV_OP_WRITE, fd, callback) != 0)
+        return -EBUSY;
+    req->buf = (void *)buf;
+    req->len = len;
+    return ev_req_submit(loop, req);
+}
+
+int ev_accept_async(ev_loop_t *loop, ev_req_t *req, int fd, struct sockaddr *addr, socklen_t *addrlen, ev_req_cb callback)
+{
+    if (ev_req_prepare(req, EV_OP_ACCEPT, fd, callback) != 0)
+        return -EBUSY;
+    req->addr = addr;
+    req->addrlen = addrlen;
+    return ev_req_submit(loop, req);
+}
+
+int ev_connect_async(ev_loop_t *loop, ev_req_t *req, int fd, const struct sockaddr *addr, socklen_t addrlen, ev_req_cb callback)
+{
+    if (ev_req_prepare(req, EV_OP_CONNECT, fd, callback) != 0)
+        return -EBUSY;
+    req->addr = (struct sockaddr *)addr;
+    req->addr_size = addrlen;
+    return ev_req_submit(loop, req);
+}
+
+int ev_sendmsg_async(ev_loop_t *loop, ev_req_t *req, int fd, const struct msghdr *msg, int flags, ev_req_cb callback)
+{
+    if (ev_req_prepare(req, EV_OP_SENDMSG, fd, callback) != 0)
+        return -EBUSY;
+    req->msg = msg;
+    req->flags = flags;
+    return ev_req_submit(loop, req);
+}
+
+int ev_send_zc_async(ev_loop_t *loop, ev_req_t *req, int fd, const void *buf, size_t len, ev_req_cb callback)
+{
+    if (ev_req_prepare(req, EV_OP_SEND_ZC, fd, callback) != 0)
+        return -EBUSY;
+    req->buf = (void *)buf;
+    req->len = len;
+    req->flags = 0;
+    return ev_req_submit(loop, req);
+}
+
+/*****
+ *
+ *
+ *
+ *
+ *
+ * Buffer Pool Realated Implementation
+ *
+ *
+ *
+ *
+ *
+ */
+
+ev_buf_pool_t *ev_buf_pool_create(ev_loop_t *loop, size_t buf_size, unsigned count)
+{
+    if (!loop || buf_size == 0 || count == 0 || count > EV_BUF_POOL_MAX_COUNT)
+        return NULL;
+
+    ev_buf_pool_t *pool = (ev_buf_pool_t *)malloc(sizeof(ev_buf_pool_t));
+    if (!pool)
+        return NULL;
+
+    if (ev_buf_pool_alloc(pool, buf_size, count) != 0)
+    {
+        free(pool);
+        return NULL;
+    }
+    pool->loop = loop;
+
+    // Let the kernel pick buffers itself where the backend supports it,
+    // otherwise the loop hands them out on readiness
+    ev_backend_buf_pool_register(loop->backend, pool);
+    return pool;
+}
+
+void ev_buf_pool_destroy(ev_buf_pool_t *pool)
+{
+    if (!pool)
+        return;
+
+    if (pool->group >= 0)
+        ev_backend_buf_pool_unregister(pool->loop->backend, pool);
+    ev_buf_pool_free(pool);
+    free(pool);
+}
+
+// Give a buffer borrowed by a pooled read back to its pool
+void ev_buf_release(ev_buf_pool_t *pool, void *buf)
+{
+    if (!pool || !buf)
+        return;
+
+    if (pool->group >= 0)
+        ev_backend_buf_pool_recycle(pool->loop->backend, pool, ev_buf_pool_id(pool, buf));
+    else
+        ev_buf_pool_put(pool, buf);
+}
+
+int ev_read_pooled_async(ev_loop_t *loop, ev_req_t *req, int fd, ev_buf_pool_t *pool, ev_req_cb callback)
+{
+    if (ev_req_prepare(req, EV_OP_READ_POOLED, fd, callback) != 0)
+        return -EBUSY;
+    req->pool = pool;
+    req->buf = NULL;
+    req->len = 0;
+    return ev_req_submit(loop, req);
+}
+
+/*****
+ *
+ *
+ *
+ *
+ *
+ * Object Pool Realated Implementation
+ *
+ *
+ *
+ *
+ *
+ */
+
+ev_pool_t *ev_pool_create(size_t size)
+{
+    return ev_slab_pool_create(size);
+}
+
+void ev_pool_destroy(ev_pool_t *pool)
+{
+    if (pool)
+        ev_slab_pool_destroy(pool);
+}
+
+void *ev_pool_alloc(ev_pool_t *pool, size_t size)
+{
+    return pool ? ev_slab_alloc(pool, size) : NULL;
+}
+
+void ev_pool_free(ev_pool_t *pool, void *ptr)
+{
+    if (pool && ptr)
+        ev_slab_free(pool, ptr);
+}
+
+// The loop's own pool, owned by the thread that first asks for it
+ev_pool_t *ev_loop_pool(ev_loop_t *loop)
+{
+    if (!loop)
+        return NULL;
+    if (!loop->pool)
+        loop->pool = ev_slab_pool_create(ev_slab_class_size(EV_POOL_CLASSES - 1));
+    return loop->pool;
+}
+
+/*****
+ *
+ *
+ *
+ *
+ *
+ * Backend Realated Implementation
+ *
+ *
+ *
+ *
+ *
+ */
+
+// Backends in the order ev_backend_init tries them
+static const ev_backend_ops_t *const backend_ops[] = {
+#if HAVE_IO_URING
+    &ev_uring_ops,
+#endif
+#if HAVE_EPOLL
+    &ev_epoll_ops,
+#endif
+#if HAVE_KQUEUE
+    &ev_kqueue_ops,
+#endif
+    &ev_poll_ops,
+};
+
+// Create the first backend of `options->backends` (any when 0) that works here
+ev_backend_t *ev_backend_init(const ev_loop_options_t *options)
+{
+    int wanted = options->backends ? options->backends : EV_BACKEND_ANY;
+
+    for (size_t i = 0; i < sizeof(backend_ops) / sizeof(backend_ops[0]); i++)
+    {
+        const ev_backend_ops_t *ops = backend_ops[i];
+        if (!(ops->kind & wanted))
+            continue;
+
+        // io_uring may be compiled in yet blocked (old kernel, seccomp), try the next one
+        ev_backend_t *backend = ops->init(options);
+        if (backend)
+        {
+            backend->ops = ops;
+            return backend;
+        }
+    }
+
+    fprintf(stderr, "No usable backend among 0x%x\n", wanted);
+    return NULL;
+}
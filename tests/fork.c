@@ -0,0 +1,97 @@
+#include "test.h"
+#include <sys/wait.h>
+
+/**
+ * Fork: after ev_loop_fork the child's loop still sees the watchers started
+ * before the fork, and ev_async_send still wakes it. The child opens new fds
+ * and watches them first; one of them usually takes the number the wakeup fd
+ * had before ev_loop_fork replaced it, and must not be mistaken for it.
+ */
+
+#define NEW_PIPES 4
+
+static ev_loop_t *loop;
+static ev_timer_t timeout;
+static ev_io_t inherited, fresh[NEW_PIPES];
+static ev_async_t async;
+static int inherited_calls, fresh_calls, async_calls;
+
+static void inherited_cb(ev_io_t *io, int revents)
+{
+    (void)revents;
+    char buf[16];
+    CHECK(read(io->fd, buf, sizeof(buf)) > 0);
+    inherited_calls++;
+}
+
+static void fresh_cb(ev_io_t *io, int revents)
+{
+    (void)io;
+    (void)revents;
+    fresh_calls++;
+}
+
+static void async_cb(ev_async_t *watcher, int revents)
+{
+    (void)watcher;
+    (void)revents;
+    async_calls++;
+}
+
+static void run_child(int writer)
+{
+    CHECK(ev_loop_fork(loop) == 0);
+
+    int pipes[NEW_PIPES][2];
+    for (int i = 0; i < NEW_PIPES; i++)
+    {
+        CHECK(pipe(pipes[i]) == 0);
+        ev_io_init(&fresh[i], fresh_cb, pipes[i][0], EV_READ);
+        ev_io_start(loop, &fresh[i]);
+    }
+
+    ev_async_send(loop, &async);
+    while (async_calls == 0)
+        ev_run(loop, EVRUN_ONCE);
+
+    CHECK(write(writer, "x", 1) == 1);
+    while (inherited_calls == 0)
+        ev_run(loop, EVRUN_ONCE);
+
+    CHECK(async_calls == 1);
+    CHECK(fresh_calls == 0);
+    exit(0);
+}
+
+int main(int argc, char **argv)
+{
+    loop = test_loop(test_backend(argc, argv));
+    int pair[2];
+    CHECK(pipe(pair) == 0);
+
+    ev_io_init(&inherited, inherited_cb, pair[0], EV_READ);
+    ev_io_start(loop, &inherited);
+    ev_async_init(&async, async_cb);
+    ev_async_start(loop, &async);
+    test_timeout(loop, &timeout, 10);
+
+    pid_t child = fork();
+    CHECK(child >= 0);
+    if (child == 0)
+        run_child(pair[1]);
+
+    int status;
+    CHECK(waitpid(child, &status, 0) == child);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // The parent's loop is unaffected by the child's
+    ev_async_send(loop, &async);
+    while (async_calls == 0)
+        ev_run(loop, EVRUN_ONCE);
+    CHECK(inherited_calls == 0);
+
+    ev_loop_destroy(loop);
+    close(pair[0]);
+    close(pair[1]);
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include "test.h"
+
+/**
+ * Prepare watchers stopped and started from callbacks of the same list: every
+ * watcher still started when the walk reaches it runs exactly once, one
+ * stopped before that doesn't run, and one started meanwhile waits for the
+ * next iteration.
+ */
+
+static ev_loop_t *loop;
+static ev_prepare_t first, second, third, late;
+static int calls[4];
+
+static void first_cb(ev_prepare_t *watcher, int revents)
+{
+    (void)watcher;
+    (void)revents;
+    calls[0]++;
+}
+
+static void second_cb(ev_prepare_t *watcher, int revents)
+{
+    (void)watcher;
+    (void)revents;
+    calls[1]++;
+}
+
+// Runs first, the walk goes from the most recently started watcher down
+static void third_cb(ev_prepare_t *watcher, int revents)
+{
+    (void)watcher;
+    (void)revents;
+    if (calls[2]++ == 0)
+    {
+        ev_prepare_stop(loop, &first);
+        ev_prepare_start(loop, &late);
+    }
+}
+
+static void late_cb(ev_prepare_t *watcher, int revents)
+{
+    (void)watcher;
+    (void)revents;
+    calls[3]++;
+}
+
+int main(int argc, char **argv)
+{
+    loop = test_loop(test_backend(argc, argv));
+
+    ev_prepare_init(&first, first_cb);
+    ev_prepare_init(&second, second_cb);
+    ev_prepare_init(&third, third_cb);
+    ev_prepare_init(&late, late_cb);
+    ev_prepare_start(loop, &first);
+    ev_prepare_start(loop, &second);
+    ev_prepare_start(loop, &third);
+
+    ev_run(loop, EVRUN_NOWAIT);
+    CHECK(calls[0] == 0 && calls[1] == 1 && calls[2] == 1 && calls[3] == 0);
+    CHECK(!first.active && first.index == -1);
+
+    ev_run(loop, EVRUN_NOWAIT);
+    CHECK(calls[0] == 0 && calls[1] == 2 && calls[2] == 2 && calls[3] == 1);
+
+    // Slots were compacted, stopping outside a walk still finds the right ones
+    ev_prepare_stop(loop, &second);
+    ev_prepare_stop(loop, &late);
+    ev_run(loop, EVRUN_NOWAIT);
+    CHECK(calls[1] == 2 && calls[2] == 3 && calls[3] == 1);
+
+    ev_prepare_stop(loop, &third);
+    ev_loop_destroy(loop);
+    return 0;
+}
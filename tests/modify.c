@@ -0,0 +1,47 @@
+#include "test.h"
+
+/**
+ * ev_io_modify keeps the trigger mode: a level-triggered watcher whose
+ * interest changed goes on firing for data nobody reads, iteration after
+ * iteration, instead of turning edge-triggered and falling silent.
+ */
+
+#define CALLS 4
+
+static ev_loop_t *loop;
+static ev_timer_t timeout;
+static ev_io_t watcher;
+static int calls;
+
+static void read_cb(ev_io_t *io, int revents)
+{
+    (void)revents;
+    // Leave the byte in the pipe, only the first call changes the interest
+    if (++calls == 1)
+        ev_io_modify(loop, io, EV_READ | EV_WRITE);
+    if (calls == CALLS)
+    {
+        ev_io_stop(loop, io);
+        ev_timer_stop(loop, &timeout);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    loop = test_loop(test_backend(argc, argv));
+    int pair[2];
+    CHECK(pipe(pair) == 0);
+    CHECK(write(pair[1], "x", 1) == 1);
+
+    ev_io_init(&watcher, read_cb, pair[0], EV_READ);
+    ev_io_start(loop, &watcher);
+    test_timeout(loop, &timeout, 10);
+    ev_run(loop, 0);
+
+    CHECK(calls == CALLS);
+
+    ev_loop_destroy(loop);
+    close(pair[0]);
+    close(pair[1]);
+    return 0;
+}
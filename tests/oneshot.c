@@ -0,0 +1,72 @@
+#include "test.h"
+#include <sys/socket.h>
+
+/**
+ * One-shot watchers: a watcher for both read and write stops after its first
+ * event, and neither filter stays behind. The same watcher memory is then
+ * reused on another fd; readiness on the first fd must not reach it.
+ */
+
+static ev_loop_t *loop;
+static ev_timer_t timeout, settle;
+static ev_io_t watcher;
+static int first_calls, stray_calls;
+
+static void first_cb(ev_io_t *io, int revents)
+{
+    (void)io;
+    (void)revents;
+    first_calls++;
+}
+
+static void stray_cb(ev_io_t *io, int revents)
+{
+    (void)io;
+    (void)revents;
+    stray_calls++;
+}
+
+// Long enough for a left-over filter to fire, then end the run
+static void settle_cb(ev_timer_t *timer, int revents)
+{
+    (void)timer;
+    (void)revents;
+    ev_io_stop(loop, &watcher);
+    ev_timer_stop(loop, &timeout);
+}
+
+int main(int argc, char **argv)
+{
+    loop = test_loop(test_backend(argc, argv));
+    int pair[2], idle[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+    CHECK(pipe(idle) == 0);
+    test_timeout(loop, &timeout, 10);
+
+    // Writable right away, readable too once the peer wrote
+    CHECK(write(pair[1], "x", 1) == 1);
+    ev_io_init(&watcher, first_cb, pair[0], EV_READ | EV_WRITE | EV_ONESHOT);
+    ev_io_start(loop, &watcher);
+    while (first_calls == 0)
+        ev_run(loop, EVRUN_ONCE);
+    CHECK(first_calls == 1);
+    CHECK(!watcher.active);
+
+    // Reuse the watcher on a pipe nobody writes to
+    ev_io_init(&watcher, stray_cb, idle[0], EV_READ);
+    ev_io_start(loop, &watcher);
+    CHECK(write(pair[1], "y", 1) == 1);
+    ev_timer_init(&settle, settle_cb, 0.1, 0);
+    ev_timer_start(loop, &settle);
+    ev_run(loop, 0);
+
+    CHECK(first_calls == 1);
+    CHECK(stray_calls == 0);
+
+    ev_loop_destroy(loop);
+    close(pair[0]);
+    close(pair[1]);
+    close(idle[0]);
+    close(idle[1]);
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include "test.h"
+#include <pthread.h>
+
+/**
+ * Loop pools: a loop created on one thread with its pool made up front and
+ * run on another. The pool belongs to the thread running the loop, so an
+ * object freed by a callback is the next one handed out (a free by another
+ * thread would be parked on the remote list instead). The creating thread
+ * may still free into it afterwards.
+ */
+
+#define OBJECTS 64
+
+static ev_loop_t *loop;
+static ev_timer_t timer;
+static void *objects[OBJECTS];
+static int reused;
+
+static void alloc_cb(ev_timer_t *watcher, int revents)
+{
+    (void)watcher;
+    (void)revents;
+    ev_pool_t *pool = ev_loop_pool(loop);
+
+    void *first = ev_pool_alloc(pool, 200);
+    CHECK(first != NULL);
+    ev_pool_free(pool, first);
+    reused = ev_pool_alloc(pool, 200) == first;
+
+    for (int i = 0; i < OBJECTS; i++)
+    {
+        objects[i] = ev_pool_alloc(pool, 200);
+        CHECK(objects[i] != NULL);
+    }
+    ev_pool_free(pool, first);
+}
+
+static void *run(void *arg)
+{
+    (void)arg;
+    ev_run(loop, 0);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    ev_loop_options_t options;
+    ev_loop_options_init(&options);
+    options.backends = test_backend(argc, argv);
+    options.pool = 1;
+    loop = ev_loop_create_with_options(&options);
+    if (!loop)
+        return TEST_SKIP;
+
+    ev_timer_init(&timer, alloc_cb, 0, 0);
+    ev_timer_start(loop, &timer);
+
+    pthread_t thread;
+    CHECK(pthread_create(&thread, NULL, run, NULL) == 0);
+    pthread_join(thread, NULL);
+    CHECK(reused);
+
+    // No longer the owner, these go on the remote list
+    for (int i = 0; i < OBJECTS; i++)
+        ev_pool_free(ev_loop_pool(loop), objects[i]);
+
+    ev_loop_destroy(loop);
+    return 0;
+}
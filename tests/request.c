@@ -0,0 +1,69 @@
+#include "test.h"
+#include <errno.h>
+
+/**
+ * Completion requests: a request set up with ev_req_init can be submitted no
+ * matter what its memory held before. Submitting it again while in flight
+ * fails with -EBUSY and leaves the request alone, and once its callback runs
+ * it may be submitted again right from there.
+ */
+
+static ev_loop_t *loop;
+static ev_timer_t timeout;
+static ev_req_t req;
+static int fds[2];
+static char data[4];
+static int results[4];
+static int completions;
+
+static void other_cb(ev_req_t *request, int result)
+{
+    (void)request;
+    (void)result;
+    CHECK(!"the rejected submission must not take over the request");
+}
+
+static void read_cb(ev_req_t *request, int result)
+{
+    CHECK(request == &req && !request->active);
+    results[completions++] = result;
+
+    if (result <= 0)
+    {
+        ev_timer_stop(loop, &timeout);
+        return;
+    }
+    if (completions == 2)
+        close(fds[1]); // The next read sees the end of the pipe
+
+    CHECK(ev_read_async(loop, request, fds[0], data + completions, 1, read_cb) == 0);
+}
+
+int main(int argc, char **argv)
+{
+    loop = test_loop(test_backend(argc, argv));
+    CHECK(pipe(fds) == 0);
+
+    // Whatever the memory held before, init makes the request usable
+    memset(&req, 0xff, sizeof(req));
+    ev_req_init(&req);
+    CHECK(!req.active);
+
+    CHECK(ev_read_async(loop, &req, fds[0], data, 1, read_cb) == 0);
+    CHECK(req.active);
+
+    CHECK(ev_read_async(loop, &req, fds[1], data + 2, 2, other_cb) == -EBUSY);
+    CHECK(req.active && req.fd == fds[0] && req.callback == read_cb && req.buf == data && req.len == 1);
+
+    test_timeout(loop, &timeout, 10);
+    CHECK(write(fds[1], "ab", 2) == 2);
+    ev_run(loop, 0);
+
+    CHECK(completions == 3);
+    CHECK(results[0] == 1 && results[1] == 1 && results[2] == 0);
+    CHECK(data[0] == 'a' && data[1] == 'b');
+
+    ev_loop_destroy(loop);
+    close(fds[0]);
+    return 0;
+}
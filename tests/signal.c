@@ -0,0 +1,62 @@
+#include "test.h"
+#include <signal.h>
+#include <sys/wait.h>
+
+/**
+ * Signal watchers: a child's exit reaches a SIGCHLD watcher and the child is
+ * still there to be reaped with waitpid. Once the watcher stops, the handler
+ * installed before it started is back in place.
+ */
+
+static ev_loop_t *loop;
+static ev_timer_t timeout;
+static ev_signal_t watcher;
+static pid_t child;
+static int reaped;
+
+static void user_handler(int signum)
+{
+    (void)signum;
+}
+
+static void child_cb(ev_signal_t *signal_watcher, int revents)
+{
+    (void)revents;
+    int status;
+    CHECK(waitpid(child, &status, 0) == child);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 7);
+    reaped = 1;
+
+    ev_signal_stop(loop, signal_watcher);
+    ev_timer_stop(loop, &timeout);
+}
+
+int main(int argc, char **argv)
+{
+    loop = test_loop(test_backend(argc, argv));
+
+    struct sigaction action = {0};
+    action.sa_handler = user_handler;
+    sigemptyset(&action.sa_mask);
+    CHECK(sigaction(SIGCHLD, &action, NULL) == 0);
+
+    ev_signal_init(&watcher, child_cb, SIGCHLD);
+    ev_signal_start(loop, &watcher);
+    CHECK(watcher.active);
+    test_timeout(loop, &timeout, 10);
+
+    child = fork();
+    CHECK(child >= 0);
+    if (child == 0)
+        _exit(7);
+
+    ev_run(loop, 0);
+    CHECK(reaped);
+
+    struct sigaction current;
+    CHECK(sigaction(SIGCHLD, NULL, &current) == 0);
+    CHECK(current.sa_handler == user_handler);
+
+    ev_loop_destroy(loop);
+    return 0;
+}
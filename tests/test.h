@@ -0,0 +1,76 @@
+#ifndef LIB_EKIO_TEST_H
+#define LIB_EKIO_TEST_H
+
+#include "libekio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Shared helpers of the regression tests.
+ *
+ * Every test is one program taking the backend as its only argument
+ * (epoll, io_uring, kqueue, poll or any, default any). It exits 0 when it
+ * passes, 1 on the first failed check and 77 when the backend isn't
+ * available here, so `make check` can run the whole set on every backend.
+ */
+
+#define TEST_SKIP 77
+
+// Fail the test with the location and the condition that didn't hold
+#define CHECK(cond)                                                                                                    \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);                                  \
+            exit(1);                                                                                                   \
+        }                                                                                                              \
+    } while (0)
+
+static inline int test_backend(int argc, char **argv)
+{
+    const char *name = argc > 1 ? argv[1] : "any";
+
+    if (strcmp(name, "epoll") == 0)
+        return EV_BACKEND_EPOLL;
+    if (strcmp(name, "io_uring") == 0)
+        return EV_BACKEND_IO_URING;
+    if (strcmp(name, "kqueue") == 0)
+        return EV_BACKEND_KQUEUE;
+    if (strcmp(name, "poll") == 0)
+        return EV_BACKEND_POLL;
+    if (strcmp(name, "any") != 0)
+    {
+        fprintf(stderr, "Unknown backend %s\n", name);
+        exit(2);
+    }
+    return EV_BACKEND_ANY;
+}
+
+// Loop on exactly the backend under test, skip the test if there is none
+static inline ev_loop_t *test_loop(int backend)
+{
+    ev_loop_t *loop = ev_loop_create_with(backend);
+    if (!loop)
+        exit(TEST_SKIP);
+    return loop;
+}
+
+// Give up on a test that stopped making progress instead of hanging `make check`
+static inline void test_timeout_cb(ev_timer_t *timer, int revents)
+{
+    (void)timer;
+    (void)revents;
+    fprintf(stderr, "timed out\n");
+    exit(1);
+}
+
+static inline void test_timeout(ev_loop_t *loop, ev_timer_t *timer, double after)
+{
+    ev_timer_init(timer, test_timeout_cb, after, 0);
+    ev_timer_start(loop, timer);
+}
+
+#endif
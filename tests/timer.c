@@ -0,0 +1,197 @@
+#include "test.h"
+
+/**
+ * Timer heap: timers fire in deadline order, never before their deadline,
+ * and a stopped one never fires. ev_timer_again pushing an idle timeout
+ * later keeps a stale key in the heap; the timer must still fire once, at
+ * its real deadline, and not at all once stopped. Moving it earlier must
+ * take effect right away. A timer restarted from its own callback with no
+ * timeout fires again in the next iteration, not over and over in this one.
+ */
+
+#define TIMER_COUNT 4096
+#define TIMER_SPREAD 0.2
+#define IDLE_TIMEOUT 0.1
+#define TICK 0.02
+#define TICKS 10
+
+static ev_loop_t *loop;
+static ev_timer_t timeout;
+static ev_timer_t timers[TIMER_COUNT];
+static double deadlines[TIMER_COUNT];
+static int fired[TIMER_COUNT];
+static double last_deadline;
+static uint64_t seed = 88172645463325252ull;
+
+static ev_timer_t idle, tick, stale, early;
+static double idle_deadline, early_deadline;
+static int idle_calls, tick_calls, stale_calls, early_calls;
+
+static ev_timer_t restart;
+static int restart_calls;
+
+// xorshift, the same deadlines on every run and backend
+static double test_random(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return (seed >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void expire_cb(ev_timer_t *timer, int revents)
+{
+    (void)revents;
+    long i = timer - timers;
+
+    CHECK(ev_now(loop) >= deadlines[i]);
+    CHECK(deadlines[i] >= last_deadline);
+    last_deadline = deadlines[i];
+    fired[i]++;
+}
+
+static void idle_cb(ev_timer_t *timer, int revents)
+{
+    (void)revents;
+    CHECK(ev_now(loop) >= idle_deadline);
+    idle_calls++;
+    ev_timer_stop(loop, timer);
+}
+
+static void stale_cb(ev_timer_t *timer, int revents)
+{
+    (void)timer;
+    (void)revents;
+    stale_calls++;
+}
+
+static void early_cb(ev_timer_t *timer, int revents)
+{
+    (void)timer;
+    (void)revents;
+    CHECK(ev_now(loop) >= early_deadline);
+    early_calls++;
+    ev_timer_stop(loop, &early);
+}
+
+static void restart_cb(ev_timer_t *timer, int revents)
+{
+    (void)revents;
+    // Bounded, so a regression fails the check below instead of hanging
+    if (++restart_calls < 1000)
+        ev_timer_start(loop, timer);
+}
+
+// Push both idle timeouts back on every tick, then let `idle` expire and
+// stop `stale` while its old key is still in the heap
+static void tick_cb(ev_timer_t *timer, int revents)
+{
+    (void)revents;
+    if (++tick_calls < TICKS)
+    {
+        ev_timer_again(loop, &idle);
+        ev_timer_again(loop, &stale);
+        idle_deadline = ev_now(loop) + IDLE_TIMEOUT;
+        return;
+    }
+    ev_timer_stop(loop, &stale);
+    ev_timer_stop(loop, timer);
+}
+
+static void check_order(void)
+{
+    ev_now_update(loop);
+    for (long i = 0; i < TIMER_COUNT; i++)
+    {
+        ev_timer_init(&timers[i], expire_cb, test_random() * TIMER_SPREAD, 0);
+        ev_timer_start(loop, &timers[i]);
+        deadlines[i] = ev_now(loop) + timers[i].after;
+    }
+
+    // Stop every third one, from the middle of the heap as well as its ends
+    for (long i = 0; i < TIMER_COUNT; i += 3)
+        ev_timer_stop(loop, &timers[i]);
+
+    for (long i = 0; i < TIMER_COUNT; i++)
+    {
+        while (timers[i].active)
+            ev_run(loop, EVRUN_ONCE);
+    }
+
+    for (long i = 0; i < TIMER_COUNT; i++)
+        CHECK(fired[i] == (i % 3 == 0 ? 0 : 1));
+}
+
+static void check_again(void)
+{
+    ev_now_update(loop);
+    ev_timer_init(&idle, idle_cb, 0, IDLE_TIMEOUT);
+    ev_timer_again(loop, &idle);
+    idle_deadline = ev_now(loop) + IDLE_TIMEOUT;
+    ev_timer_init(&stale, stale_cb, 0, IDLE_TIMEOUT);
+    ev_timer_again(loop, &stale);
+    ev_timer_init(&tick, tick_cb, TICK, TICK);
+    ev_timer_start(loop, &tick);
+
+    while (idle.active || tick.active)
+        ev_run(loop, EVRUN_ONCE);
+
+    CHECK(tick_calls == TICKS);
+    CHECK(idle_calls == 1);
+    CHECK(stale_calls == 0);
+}
+
+// A long timeout moved earlier must not wait for its first deadline, nor for
+// the timers that were due before it
+static void check_earlier(void)
+{
+    ev_now_update(loop);
+    for (long i = 0; i < 8; i++)
+    {
+        ev_timer_init(&timers[i], stale_cb, 5 + i, 0);
+        ev_timer_start(loop, &timers[i]);
+    }
+    ev_timer_init(&early, early_cb, 0, 10);
+    ev_timer_again(loop, &early);
+    early.repeat = TICK;
+    ev_timer_again(loop, &early);
+    early_deadline = ev_now(loop) + TICK;
+
+    while (early.active)
+        ev_run(loop, EVRUN_ONCE);
+
+    CHECK(early_calls == 1);
+    CHECK(ev_now(loop) < early_deadline + 1);
+    for (long i = 0; i < 8; i++)
+        ev_timer_stop(loop, &timers[i]);
+    CHECK(stale_calls == 0);
+}
+
+static void check_restart(void)
+{
+    ev_timer_init(&restart, restart_cb, 0, 0);
+    ev_timer_start(loop, &restart);
+
+    while (restart_calls == 0)
+        ev_run(loop, EVRUN_ONCE);
+    CHECK(restart_calls == 1);
+    while (restart_calls == 1)
+        ev_run(loop, EVRUN_ONCE);
+    CHECK(restart_calls == 2);
+    ev_timer_stop(loop, &restart);
+}
+
+int main(int argc, char **argv)
+{
+    loop = test_loop(test_backend(argc, argv));
+    test_timeout(loop, &timeout, 10);
+
+    check_order();
+    check_again();
+    check_earlier();
+    check_restart();
+
+    ev_timer_stop(loop, &timeout);
+    ev_loop_destroy(loop);
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "test.h"
+#include <pthread.h>
+
+/**
+ * Cross-thread wakeup: several producers post tasks and send an async
+ * watcher as fast as they can. Every task has to run and the last send has
+ * to be seen, a wakeup lost while the loop drains its fd leaves the loop
+ * asleep on queued work until the timeout fails the test.
+ */
+
+#define PRODUCERS 4
+#define POSTS 200000
+
+static ev_loop_t *loop;
+static ev_task_t *tasks;
+static ev_async_t async_watcher;
+static ev_timer_t timeout;
+static long ran;
+static int sent_last;
+
+// Done once every task ran and every producer's last send arrived
+static void check_done(void)
+{
+    if (ran == (long)PRODUCERS * POSTS && __atomic_load_n(&sent_last, __ATOMIC_ACQUIRE) == PRODUCERS)
+    {
+        ev_async_stop(loop, &async_watcher);
+        ev_timer_stop(loop, &timeout);
+    }
+}
+
+static void task_fn(void *data)
+{
+    (void)data;
+    ran++;
+    check_done();
+}
+
+static void async_cb(ev_async_t *watcher, int revents)
+{
+    (void)watcher;
+    (void)revents;
+    check_done();
+}
+
+static void *producer(void *arg)
+{
+    ev_task_t *mine = (ev_task_t *)arg;
+    for (int i = 0; i < POSTS; i++)
+    {
+        ev_task_init(&mine[i], task_fn, NULL);
+        ev_loop_post(loop, &mine[i]);
+        if (i % 64 == 0)
+            ev_async_send(loop, &async_watcher);
+    }
+
+    // The loop may only stop once it saw this send
+    __atomic_add_fetch(&sent_last, 1, __ATOMIC_RELEASE);
+    ev_async_send(loop, &async_watcher);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    loop = test_loop(test_backend(argc, argv));
+    tasks = (ev_task_t *)calloc((size_t)PRODUCERS * POSTS, sizeof(ev_task_t));
+    CHECK(tasks != NULL);
+
+    ev_async_init(&async_watcher, async_cb);
+    ev_async_start(loop, &async_watcher);
+    test_timeout(loop, &timeout, 30);
+
+    pthread_t threads[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; i++)
+        CHECK(pthread_create(&threads[i], NULL, producer, tasks + (size_t)i * POSTS) == 0);
+
+    ev_run(loop, 0);
+
+    for (int i = 0; i < PRODUCERS; i++)
+        pthread_join(threads[i], NULL);
+    CHECK(ran == (long)PRODUCERS * POSTS);
+
+    ev_loop_destroy(loop);
+    free(tasks);
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "test.h"
+#include <pthread.h>
+
+/**
+ * Thread pool completions: several loops, each on its own thread, queue many
+ * work items on the shared pool. Every done callback has to run exactly once,
+ * on the loop that submitted the item and after the work ran. Each loop only
+ * returns once its last item came back, so a lost completion hangs the test
+ * until the timeout fails it.
+ */
+
+#define LOOPS 4
+#define ITEMS 50000
+
+typedef struct item item_t;
+
+typedef struct submitter
+{
+    ev_loop_t *loop;
+    item_t *items;
+    ev_timer_t timeout;
+    long done;
+    long wrong;
+} submitter_t;
+
+struct item
+{
+    ev_work_t work;
+    submitter_t *owner;
+    int ran;
+    int done;
+};
+
+static void work_fn(ev_work_t *work)
+{
+    item_t *item = (item_t *)work->data;
+    item->ran++;
+}
+
+static void done_cb(ev_work_t *work, int status)
+{
+    item_t *item = (item_t *)work->data;
+    submitter_t *owner = item->owner;
+
+    if (status != 0 || item->ran != 1 || item->done++ != 0 || ev_current_loop() != owner->loop)
+        owner->wrong++;
+    if (++owner->done == ITEMS)
+        ev_timer_stop(owner->loop, &owner->timeout);
+}
+
+static void *submit_and_run(void *arg)
+{
+    submitter_t *submitter = (submitter_t *)arg;
+
+    test_timeout(submitter->loop, &submitter->timeout, 30);
+    for (int i = 0; i < ITEMS; i++)
+    {
+        item_t *item = &submitter->items[i];
+        item->owner = submitter;
+        item->work.data = item;
+        CHECK(ev_work_submit(submitter->loop, &item->work, work_fn, done_cb) == 0);
+    }
+    ev_run(submitter->loop, 0);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int backend = test_backend(argc, argv);
+    submitter_t submitters[LOOPS];
+    pthread_t threads[LOOPS];
+
+    for (int i = 0; i < LOOPS; i++)
+    {
+        memset(&submitters[i], 0, sizeof(submitter_t));
+        submitters[i].loop = test_loop(backend);
+        submitters[i].items = (item_t *)calloc(ITEMS, sizeof(item_t));
+        CHECK(submitters[i].items != NULL);
+    }
+    for (int i = 0; i < LOOPS; i++)
+        CHECK(pthread_create(&threads[i], NULL, submit_and_run, &submitters[i]) == 0);
+
+    for (int i = 0; i < LOOPS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        CHECK(submitters[i].done == ITEMS);
+        CHECK(submitters[i].wrong == 0);
+        ev_loop_destroy(submitters[i].loop);
+        free(submitters[i].items);
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include "test.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/**
+ * Zero-copy send on a shared fd: a read watcher and ev_send_zc_async use the
+ * same socket. After the send the request waits for the kernel's completion,
+ * reported as an error on the fd, with no read or write interest of its own.
+ * It has to complete even though the fd's registration is the reader's, and
+ * the reader still has to see the peer's reply.
+ */
+
+#define SEND_SIZE (4 << 20)
+
+static ev_loop_t *loop;
+static ev_timer_t timeout;
+static ev_io_t reader, peer_reader;
+static ev_req_t req;
+static char *payload;
+static long sent = -1, received;
+static int peer = -1, replied, reply_seen, completed;
+
+static void check_done(void)
+{
+    if (completed && reply_seen)
+        ev_timer_stop(loop, &timeout);
+}
+
+// Answer once everything the send put on the wire arrived
+static void maybe_reply(void)
+{
+    if (replied || sent < 0 || received < sent)
+        return;
+    CHECK(write(peer, "k", 1) == 1);
+    replied = 1;
+    ev_io_stop(loop, &peer_reader);
+}
+
+static void peer_cb(ev_io_t *watcher, int revents)
+{
+    (void)revents;
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(watcher->fd, buf, sizeof(buf))) > 0)
+        received += n;
+    maybe_reply();
+}
+
+static void reader_cb(ev_io_t *watcher, int revents)
+{
+    (void)revents;
+    char c;
+    if (read(watcher->fd, &c, 1) != 1)
+        return; // Woken by the send's completion, nothing to read yet
+
+    CHECK(c == 'k');
+    reply_seen = 1;
+    ev_io_stop(loop, watcher);
+    check_done();
+}
+
+static void send_cb(ev_req_t *request, int result)
+{
+    (void)request;
+    CHECK(result > 0);
+    sent = result;
+    completed = 1;
+    maybe_reply();
+    check_done();
+}
+
+int main(int argc, char **argv)
+{
+    loop = test_loop(test_backend(argc, argv));
+
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(listen_fd >= 0);
+    CHECK(bind(listen_fd, (struct sockaddr *)&addr, len) == 0 && listen(listen_fd, 1) == 0);
+    CHECK(getsockname(listen_fd, (struct sockaddr *)&addr, &len) == 0);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(connect(fd, (struct sockaddr *)&addr, len) == 0);
+    peer = accept(listen_fd, NULL, NULL);
+    CHECK(peer >= 0);
+
+    payload = (char *)malloc(SEND_SIZE);
+    CHECK(payload != NULL);
+    memset(payload, 'z', SEND_SIZE);
+
+    test_timeout(loop, &timeout, 10);
+    ev_io_init(&reader, reader_cb, fd, EV_READ);
+    ev_io_start(loop, &reader);
+    ev_io_init(&peer_reader, peer_cb, peer, EV_READ);
+    ev_io_start(loop, &peer_reader);
+    ev_req_init(&req);
+    CHECK(ev_send_zc_async(loop, &req, fd, payload, SEND_SIZE, send_cb) == 0);
+
+    ev_run(loop, 0);
+    CHECK(completed && reply_seen);
+    CHECK(received == sent);
+
+    ev_loop_destroy(loop);
+    close(fd);
+    close(peer);
+    close(listen_fd);
+    free(payload);
+    return 0;
+}